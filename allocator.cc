@@ -1,8 +1,11 @@
 #include <sys/mman.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <map>
+#include <memory>
 #include <iostream>
 #include <cstring>
+#include <cstddef>
 #include <numa.h>
 
 #include "allocator.h"
@@ -16,6 +19,51 @@ using namespace util;
 static event_counter evt_allocator_total_region_usage(
     "allocator_total_region_usage_bytes");
 
+namespace {
+  // layout of backing_dir/heap.meta, which describes a persistent heap
+  struct heapmeta {
+    static const uint64_t Magic = 0x5041454854534f4eUL;
+    static const size_t MaxRoots = 256;
+    static const size_t MaxRootName = 56;
+
+    uint64_t magic;
+    uint64_t clean; // set only by a completed allocator::Shutdown()
+    uint64_t ncpus;
+    uint64_t maxpercore;
+    uint64_t nroots;
+    struct {
+      uint64_t region_used; // bytes handed out from the region
+      void *arenas[allocator::MAX_ARENAS];
+    } regions[NMAXCORES];
+    struct {
+      char name[MaxRootName];
+      uint64_t value;
+    } roots[MaxRoots];
+  };
+}
+
+static std::mutex g_roots_lock;
+static std::map<std::string, uint64_t> g_roots;
+
+static void
+write_heapmeta(int fd, const void *p, size_t n, off_t off)
+{
+  size_t done = 0;
+  while (done < n) {
+    const ssize_t ret =
+      pwrite(fd, (const char *) p + done, n - done, off + done);
+    if (ret == -1) {
+      perror("pwrite");
+      ALWAYS_ASSERT(false);
+    }
+    done += ret;
+  }
+  if (fsync(fd)) {
+    perror("fsync");
+    ALWAYS_ASSERT(false);
+  }
+}
+
 // page+alloc routines taken from masstree
 
 #ifdef MEMCHECK_MAGIC
@@ -75,7 +123,8 @@ allocator::UseMAdvWillNeed()
 }
 
 void
-allocator::Initialize(size_t ncpus, size_t maxpercore)
+allocator::Initialize(size_t ncpus, size_t maxpercore,
+                      const std::string &backing_dir)
 {
   static spinlock s_lock;
   static bool s_init = false;
@@ -101,13 +150,24 @@ allocator::Initialize(size_t ncpus, size_t maxpercore)
   // (this does not actually cause physical pages to be allocated)
   // note: we allocate an extra hugepgsize so we can guarantee alignment
   // of g_memstart to a huge page boundary
-
-  void * const x = mmap(nullptr, g_ncpus * g_maxpercore + hugepgsize,
-      PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  //
+  // a persistent heap must land on the same address every time, so we
+  // only hint at PersistentMemStart (MAP_FIXED would silently clobber
+  // whatever lives there) and bail if the kernel put us elsewhere
+
+  void * const hint = backing_dir.empty() ?
+    nullptr : reinterpret_cast<void *>(PersistentMemStart);
+  void * const x = mmap(hint, g_ncpus * g_maxpercore + hugepgsize,
+      PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
   if (x == MAP_FAILED) {
     perror("mmap");
     ALWAYS_ASSERT(false);
   }
+  if (hint && x != hint) {
+    std::cerr << "allocator::Initialize(): could not reserve " << hint
+              << " for a persistent heap (got " << x << ")" << std::endl;
+    ALWAYS_ASSERT(false);
+  }
 
   void * const endpx = (void *) ((uintptr_t)x + g_ncpus * g_maxpercore + hugepgsize);
   std::cerr << "allocator::Initialize()" << std::endl
@@ -127,16 +187,169 @@ allocator::Initialize(size_t ncpus, size_t maxpercore)
       reinterpret_cast<char *>(g_memstart) + (i * g_maxpercore);
     g_regions[i].region_end   =
       reinterpret_cast<char *>(g_memstart) + ((i + 1) * g_maxpercore);
+    g_regions[i].region_node = numa_node_of_cpu(i);
     std::cerr << "cpu" << i << " owns [" << g_regions[i].region_begin
-              << ", " << g_regions[i].region_end << ")" << std::endl;
+              << ", " << g_regions[i].region_end << ") on node "
+              << g_regions[i].region_node << std::endl;
     ALWAYS_ASSERT(g_regions[i].region_begin < g_regions[i].region_end);
     ALWAYS_ASSERT(g_regions[i].region_begin >= x);
     ALWAYS_ASSERT(g_regions[i].region_end <= endpx);
   }
 
+  if (!backing_dir.empty())
+    InitializeBacking(backing_dir);
+
   s_init = true;
 }
 
+void
+allocator::InitializeBacking(const std::string &backing_dir)
+{
+  static const size_t hugepgsize = GetHugepageSize();
+  ALWAYS_ASSERT(g_ncpus <= NMAXCORES);
+
+  const std::string metafile = backing_dir + "/heap.meta";
+  const int fd = open(metafile.c_str(), O_CREAT | O_RDWR, 0664);
+  if (fd == -1) {
+    perror("open");
+    ALWAYS_ASSERT(false);
+  }
+
+  std::unique_ptr<heapmeta> m(new heapmeta);
+  const ssize_t n = pread(fd, m.get(), sizeof(*m), 0);
+  if (n == -1) {
+    perror("pread");
+    ALWAYS_ASSERT(false);
+  }
+  g_warm_restart =
+    size_t(n) == sizeof(*m) &&
+    m->magic == heapmeta::Magic &&
+    m->clean &&
+    m->ncpus == g_ncpus &&
+    m->maxpercore == g_maxpercore;
+  if (!g_warm_restart) {
+    NDB_MEMSET(m.get(), 0, sizeof(*m));
+    m->magic = heapmeta::Magic;
+    m->ncpus = g_ncpus;
+    m->maxpercore = g_maxpercore;
+  }
+
+  // from here on, a crash must not look like a clean shutdown
+  m->clean = 0;
+  write_heapmeta(fd, m.get(), sizeof(*m), 0);
+
+  for (size_t i = 0; i < g_ncpus; i++) {
+    regionctx &pc = g_regions[i];
+    const std::string f = backing_dir + "/region." + std::to_string(i);
+    const int rfd =
+      open(f.c_str(), O_CREAT | O_RDWR | (g_warm_restart ? 0 : O_TRUNC), 0664);
+    if (rfd == -1) {
+      perror("open");
+      ALWAYS_ASSERT(false);
+    }
+    if (ftruncate(rfd, g_maxpercore)) {
+      perror("ftruncate");
+      ALWAYS_ASSERT(false);
+    }
+    pc.backing_fd = rfd;
+    pc.backing_start = pc.region_begin;
+    if (!g_warm_restart)
+      continue;
+
+    // bring back everything handed out by the last process
+    const size_t used = m->regions[i].region_used;
+    ALWAYS_ASSERT(used <= g_maxpercore);
+    ALWAYS_ASSERT(!(used % hugepgsize));
+    if (used)
+      MapRegion(pc, pc.region_begin, used);
+    pc.region_begin = reinterpret_cast<char *>(pc.region_begin) + used;
+    NDB_MEMCPY(pc.arenas, m->regions[i].arenas, sizeof(pc.arenas));
+    evt_allocator_total_region_usage.inc(used);
+  }
+
+  if (g_warm_restart) {
+    ALWAYS_ASSERT(m->nroots <= heapmeta::MaxRoots);
+    lock_guard<std::mutex> l(g_roots_lock);
+    for (size_t i = 0; i < m->nroots; i++)
+      g_roots[m->roots[i].name] = m->roots[i].value;
+  }
+
+  g_backing_fd = fd;
+  std::cerr << "  " << (g_warm_restart ? "reattached to" : "created")
+            << " heap in " << backing_dir << std::endl;
+}
+
+void
+allocator::SetRoot(const std::string &name, uint64_t value)
+{
+  ALWAYS_ASSERT(name.size() < heapmeta::MaxRootName);
+  lock_guard<std::mutex> l(g_roots_lock);
+  g_roots[name] = value;
+}
+
+bool
+allocator::GetRoot(const std::string &name, uint64_t &value)
+{
+  lock_guard<std::mutex> l(g_roots_lock);
+  auto it = g_roots.find(name);
+  if (it == g_roots.end())
+    return false;
+  value = it->second;
+  return true;
+}
+
+bool
+allocator::Shutdown()
+{
+  if (!IsPersistent())
+    return false;
+  const uint64_t nescaped =
+    g_escaped_allocations.load(std::memory_order_acquire);
+  if (nescaped) {
+    std::cerr << "allocator::Shutdown(): " << nescaped
+              << " allocations escaped the regions, heap is not restartable"
+              << std::endl;
+    return false;
+  }
+
+  std::unique_ptr<heapmeta> m(new heapmeta);
+  NDB_MEMSET(m.get(), 0, sizeof(*m));
+  m->magic = heapmeta::Magic;
+  m->ncpus = g_ncpus;
+  m->maxpercore = g_maxpercore;
+  for (size_t i = 0; i < g_ncpus; i++) {
+    regionctx &pc = g_regions[i];
+    lock_guard<spinlock> l(pc.lock);
+    const size_t used =
+      reinterpret_cast<uintptr_t>(pc.region_begin) -
+      reinterpret_cast<uintptr_t>(pc.backing_start);
+    m->regions[i].region_used = used;
+    NDB_MEMCPY(m->regions[i].arenas, pc.arenas, sizeof(pc.arenas));
+    // a no-op on hugetlbfs/tmpfs, but not on a real filesystem
+    if (used && msync(pc.backing_start, used, MS_SYNC)) {
+      perror("msync");
+      ALWAYS_ASSERT(false);
+    }
+  }
+  {
+    lock_guard<std::mutex> l(g_roots_lock);
+    ALWAYS_ASSERT(g_roots.size() <= heapmeta::MaxRoots);
+    for (auto &p : g_roots) {
+      NDB_MEMCPY(m->roots[m->nroots].name, p.first.data(), p.first.size());
+      m->roots[m->nroots].value = p.second;
+      m->nroots++;
+    }
+  }
+
+  // write everything out before flipping the clean bit, so a torn write
+  // can never be mistaken for a clean heap
+  write_heapmeta(g_backing_fd, m.get(), sizeof(*m), 0);
+  m->clean = 1;
+  write_heapmeta(g_backing_fd, &m->clean, sizeof(m->clean),
+                 offsetof(heapmeta, clean));
+  return true;
+}
+
 void
 allocator::DumpStats()
 {
@@ -151,6 +364,19 @@ allocator::DumpStats()
   }
 }
 
+size_t
+allocator::GetUsedBytes()
+{
+  size_t used = 0;
+  for (size_t i = 0; i < g_ncpus; i++) {
+    regionctx &pc = g_regions[i];
+    lock_guard<spinlock> l(pc.lock);
+    used += reinterpret_cast<uintptr_t>(pc.region_begin) -
+      (reinterpret_cast<uintptr_t>(g_memstart) + i * g_maxpercore);
+  }
+  return used;
+}
+
 static void *
 initialize_page(void *page, const size_t pagesize, const size_t unit)
 {
@@ -244,25 +470,43 @@ allocator::AllocateUnmanagedWithLock(regionctx &pc, size_t nhugepgs)
 
   evt_allocator_total_region_usage.inc(nhugepgs * hugepgsize);
 
-  if (needs_mmap) {
-    void * const x = mmap(mypx, hugepgsize, PROT_READ | PROT_WRITE,
-        MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
-    if (unlikely(x == MAP_FAILED)) {
-      perror("mmap");
-      ALWAYS_ASSERT(false);
-    }
-    INVARIANT(x == mypx);
-    const int advice =
-      UseMAdvWillNeed() ? MADV_HUGEPAGE | MADV_WILLNEED : MADV_HUGEPAGE;
-    if (madvise(x, hugepgsize, advice)) {
-      perror("madvise");
-      ALWAYS_ASSERT(false);
-    }
-  }
+  if (needs_mmap)
+    MapRegion(pc, mypx, nhugepgs * hugepgsize);
 
   return mypx;
 }
 
+void
+allocator::MapRegion(regionctx &pc, void *px, size_t sz)
+{
+  const bool backed = pc.backing_fd != -1;
+  void * const x = backed ?
+    mmap(px, sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+         pc.backing_fd,
+         reinterpret_cast<char *>(px) -
+         reinterpret_cast<char *>(pc.backing_start)) :
+    mmap(px, sz, PROT_READ | PROT_WRITE,
+         MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+  if (unlikely(x == MAP_FAILED)) {
+    perror("mmap");
+    std::cerr << "  [" << px << ", "
+              << (void *) (reinterpret_cast<char *>(px) + sz) << ")"
+              << std::endl;
+    ALWAYS_ASSERT(false);
+  }
+  ALWAYS_ASSERT(x == px);
+  // hugetlbfs is huge by construction (and tmpfs by its huge= mount
+  // option), so the advice only applies to anonymous memory
+  if (backed)
+    return;
+  const int advice =
+    UseMAdvWillNeed() ? MADV_HUGEPAGE | MADV_WILLNEED : MADV_HUGEPAGE;
+  if (madvise(x, sz, advice)) {
+    perror("madvise");
+    ALWAYS_ASSERT(false);
+  }
+}
+
 void
 allocator::ReleaseArenas(void **arenas)
 {
@@ -334,26 +578,15 @@ allocator::FaultRegion(size_t cpu)
   const size_t sz =
     reinterpret_cast<uintptr_t>(pc.region_end) -
     reinterpret_cast<uintptr_t>(pc.region_begin);
-  void * const x = mmap(pc.region_begin, sz, PROT_READ | PROT_WRITE,
-      MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
-  if (unlikely(x == MAP_FAILED)) {
-    perror("mmap");
-    std::cerr << "  cpu" << cpu
-              << " [" << pc.region_begin << ", " << pc.region_end << ")"
-              << std::endl;
-    ALWAYS_ASSERT(false);
-  }
-  ALWAYS_ASSERT(x == pc.region_begin);
-  const int advice =
-    UseMAdvWillNeed() ? MADV_HUGEPAGE | MADV_WILLNEED : MADV_HUGEPAGE;
-  if (madvise(x, sz, advice)) {
-    perror("madvise");
-    ALWAYS_ASSERT(false);
+  if (!sz) {
+    pc.region_faulted = true;
+    return;
   }
+  MapRegion(pc, pc.region_begin, sz);
   numa_hint_memory_placement(
       pc.region_begin,
       (uintptr_t)pc.region_end - (uintptr_t)pc.region_begin,
-      numa_node_of_cpu(cpu));
+      pc.region_node);
   const size_t nfaults =
     ((uintptr_t)pc.region_end - (uintptr_t)pc.region_begin) / hugepgsize;
   std::cerr << "cpu" << cpu << " starting faulting region ("
@@ -374,3 +607,6 @@ void *allocator::g_memend = nullptr;
 size_t allocator::g_ncpus = 0;
 size_t allocator::g_maxpercore = 0;
 percore<allocator::regionctx> allocator::g_regions;
+int allocator::g_backing_fd = -1;
+bool allocator::g_warm_restart = false;
+std::atomic<uint64_t> allocator::g_escaped_allocations(0);
@@ -4,6 +4,8 @@
 #include <cstdint>
 #include <iterator>
 #include <mutex>
+#include <string>
+#include <atomic>
 
 #include "util.h"
 #include "core.h"
@@ -18,10 +20,58 @@ public:
   // Initialize can be called many times- but only the first call has effect.
   //
   // w/o calling Initialize(), behavior for this class is undefined
-  static void Initialize(size_t ncpus, size_t maxpercore);
+  //
+  // if backing_dir is not empty, each cpu's region is backed by a file in
+  // backing_dir (meant to be a hugetlbfs or tmpfs mount) and mapped at a
+  // fixed address. if backing_dir holds the heap of a process which called
+  // Shutdown(), with the same ncpus/maxpercore, the regions are remapped
+  // as they were left- see IsWarmRestart()
+  static void Initialize(size_t ncpus, size_t maxpercore,
+                         const std::string &backing_dir = "");
+
+  // true if the regions are file backed
+  static inline bool
+  IsPersistent()
+  {
+    return g_backing_fd != -1;
+  }
+
+  // true if Initialize() reattached to a previous process' heap. everything
+  // reachable from GetRoot() is valid again
+  static inline bool
+  IsWarmRestart()
+  {
+    return g_warm_restart;
+  }
+
+  // named values (usually pointers into the regions) which survive a
+  // restart. not meant to be called on any fast path
+  static void SetRoot(const std::string &name, uint64_t value);
+  static bool GetRoot(const std::string &name, uint64_t &value);
+
+  // records that an allocation escaped the regions (ie was malloc()-ed)
+  // while persistent- such a heap cannot be restarted from
+  static inline void
+  NoteEscapedAllocation()
+  {
+    g_escaped_allocations.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // persists the per-region state and roots, and marks the heap clean so the
+  // next Initialize() can reattach to it. only call once the system is
+  // quiescent, and don't allocate afterwards. returns false (leaving the heap
+  // unclean) if the heap cannot be restarted from.
+  //
+  // XXX: memory sitting in per-thread arena caches, and frees still pending
+  // in RCU, is leaked across a restart
+  static bool Shutdown();
 
   static void DumpStats();
 
+  // bytes handed out of the regions so far, summed over all cpus- this
+  // includes memory sitting free in the arenas
+  static size_t GetUsedBytes();
+
   // returns an arena linked-list
   static void *
   AllocateArenas(size_t cpu, size_t sz);
@@ -42,6 +92,10 @@ public:
   static const size_t AllocAlignment = 1 << LgAllocAlignment;
   static const size_t MAX_ARENAS = 32;
 
+  // where persistent regions are mapped, so pointers into them stay valid
+  // across restarts
+  static const uintptr_t PersistentMemStart = 0x400000000000UL;
+
   static inline std::pair<size_t, size_t>
   ArenaSize(size_t sz)
   {
@@ -75,6 +129,21 @@ public:
     return ret;
   }
 
+  // the numa node CPU's region is placed on
+  static inline int
+  CpuToNode(size_t cpu)
+  {
+    INVARIANT(cpu < g_ncpus);
+    return g_regions[cpu].region_node;
+  }
+
+  // assumes p is managed by this allocator
+  static inline int
+  PointerToNode(const void *p)
+  {
+    return CpuToNode(PointerToCpu(p));
+  }
+
 #ifdef MEMCHECK_MAGIC
   struct pgmetadata {
     uint32_t unit_; // 0-indexed
@@ -109,7 +178,10 @@ private:
     regionctx()
       : region_begin(nullptr),
         region_end(nullptr),
-        region_faulted(false)
+        region_node(-1),
+        region_faulted(false),
+        backing_fd(-1),
+        backing_start(nullptr)
     {
       NDB_MEMSET(arenas, 0, sizeof(arenas));
     }
@@ -120,9 +192,14 @@ private:
     // set by Initialize()
     void *region_begin;
     void *region_end;
+    int region_node;
 
     bool region_faulted;
 
+    // if persistent: the file backing [backing_start, region_end)
+    int backing_fd;
+    void *backing_start;
+
     spinlock lock;
     std::mutex fault_lock; // XXX: hacky
     void *arenas[MAX_ARENAS];
@@ -133,6 +210,13 @@ private:
   static void *
   AllocateUnmanagedWithLock(regionctx &pc, size_t nhugepgs);
 
+  // maps [px, px + sz) of pc's region read/write, either anonymously or from
+  // its backing file
+  static void
+  MapRegion(regionctx &pc, void *px, size_t sz);
+
+  static void InitializeBacking(const std::string &backing_dir);
+
   // [g_memstart, g_memstart + ncpus * maxpercore) is the region of memory mmap()-ed
   static void *g_memstart;
   static void *g_memend; // g_memstart + ncpus * maxpercore
@@ -140,6 +224,10 @@ private:
   static size_t g_maxpercore;
 
   static percore<regionctx> g_regions CACHE_ALIGNED;
+
+  static int g_backing_fd; // the heap metadata file, -1 if not persistent
+  static bool g_warm_restart;
+  static std::atomic<uint64_t> g_escaped_allocations;
 };
 
 #endif /* _NDB_ALLOCATOR_H_ */
@@ -17,6 +17,10 @@ template <template <typename> class Transaction>
 struct base_txn_btree_handler {
   static inline void on_construct() {} // called when initializing
   static const bool has_background_task = false;
+  // version given to records inserted outside of any txn (bulk_load())
+  static inline transaction_base::tid_t load_tid() { return dbtuple::MIN_TID; }
+  // may purge_tombstones() unlink this (locked) tombstone from its tree?
+  static inline bool can_purge_tombstone(const dbtuple *tuple) { return false; }
 };
 
 template <template <typename> class Transaction, typename P>
@@ -32,20 +36,33 @@ public:
             bool mostly_append = false,
             const std::string &name = "<unknown>")
     : value_size_hint(value_size_hint),
+      mostly_append(mostly_append),
       name(name),
-      been_destructed(false)
+      been_destructed(false),
+      cold_compression_idle_ticks(0),
+      eviction_idle_ticks(0)
   {
     base_txn_btree_handler<Transaction>::on_construct();
+    conflict_sampler::register_table(&underlying_btree, name);
   }
 
   ~base_txn_btree()
   {
     if (!been_destructed)
       unsafe_purge(false);
+    conflict_sampler::unregister_table(&underlying_btree);
   }
 
+  // cheap, counts keys of logically deleted records not yet gc-ed
   inline size_t
   size_estimate() const
+  {
+    return underlying_btree.size_estimate();
+  }
+
+  // like size_estimate(), but walks the whole tree
+  inline size_t
+  size_exact() const
   {
     return underlying_btree.size();
   }
@@ -62,10 +79,43 @@ public:
     this->value_size_hint = value_size_hint;
   }
 
+  // keys are mostly inserted in increasing order. masstree already splits
+  // a full rightmost leaf 100/0 on such appends (see bulk_load()), so this
+  // only steers which optional lookup structures are worth keeping
+  inline bool
+  is_mostly_append() const
+  {
+    return mostly_append;
+  }
+
   inline void print() {
     underlying_btree.print();
   }
 
+  /**
+   * O(1) lookups of present keys, via a hash index kept next to the tree
+   * (see mbtree::enable_point_index()). Not threadsafe
+   */
+  inline void
+  enable_point_index()
+  {
+    underlying_btree.enable_point_index();
+  }
+
+  // per-core cache of where hot keys live (see
+  // mbtree::enable_leaf_cache()). Not threadsafe
+  inline void
+  enable_leaf_cache()
+  {
+    underlying_btree.enable_leaf_cache();
+  }
+
+  inline void
+  leaf_cache_stats(uint64_t &hits, uint64_t &misses) const
+  {
+    underlying_btree.leaf_cache_stats(hits, misses);
+  }
+
   /**
    * only call when you are sure there are no concurrent modifications on the
    * tree. is neither threadsafe nor transactional
@@ -76,8 +126,311 @@ public:
    */
   std::map<std::string, uint64_t> unsafe_purge(bool dump_stats = false);
 
+  /**
+   * Warm restart support: the root of the underlying tree, and adopting
+   * one saved by an earlier process. Only meaningful when that process'
+   * heap was reattached (allocator::IsWarmRestart()). Neither is threadsafe
+   */
+  inline const void *
+  unsafe_root() const
+  {
+    return underlying_btree.unsafe_root();
+  }
+
+  inline void
+  unsafe_reattach(const void *root)
+  {
+    underlying_btree.unsafe_reattach(root);
+  }
+
+  /**
+   * Cuts [lower, upper) (upper == nullptr is unbounded) into at most
+   * nparts consecutive pieces of roughly equal size, at keys sampled from
+   * the tree's interior nodes. Returns the lower bound of each piece in
+   * order- the first is lower, and each piece ends where the next begins.
+   * Not transactional, and cheap: no leaf is visited
+   */
+  std::vector<std::string>
+  split_range(const std::string &lower, const std::string *upper,
+              size_t nparts) const;
+
+  /**
+   * Bulk loading: inserts each (key, value) pair of [begin, end) as a new
+   * record straight into the tree, skipping txns altogether. values are raw
+   * record bytes. Records appear one at a time, versioned older than any
+   * txn which commits after the call, so loading is safe alongside txns
+   * (a txn which saw a key absent aborts as it would on a racing insert).
+   * Keys already present are skipped. Nothing is logged.
+   *
+   * Input sorted by key fills leaves completely, since masstree splits an
+   * append off a full leaf by moving just the new key. Returns the number
+   * of records loaded
+   */
+  template <typename InputIterator>
+  size_t bulk_load(InputIterator begin, InputIterator end);
+
+  /**
+   * Online compaction: re-packs latest tuples whose alloc_size exceeds what
+   * their current size needs by at least min_slack_bytes (the leftovers of
+   * a value which grew via spills and later shrank) into right-sized
+   * allocations, swapping the copy into the tree and retiring the old tuple
+   * through RCU.
+   *
+   * Is threadsafe, but any concurrent txn which touched a swapped tuple will
+   * fail validation and abort, so this is meant to be run when the table is
+   * quiet. Returns the number of bytes reclaimed
+   */
+  size_t compact(size_type min_slack_bytes = 64);
+
+  /**
+   * Enables cold tuple compression for this table: tuples which have not
+   * been read for at least min_idle_ticks ticker ticks are LZ4 compressed
+   * by compress_cold(). 0 disables. Requires TUPLE_COLD_COMPRESSION
+   */
+  inline void
+  set_cold_compression(uint8_t min_idle_ticks)
+  {
+    cold_compression_idle_ticks = min_idle_ticks;
+  }
+
+  inline bool
+  is_cold_compression_enabled() const
+  {
+    return cold_compression_idle_ticks;
+  }
+
+  /**
+   * Background pass which replaces cold tuples with compressed copies (reads
+   * inflate them into the txn's string arena, writes spill them back into a
+   * regular tuple). Same concurrency caveats as compact(). Returns the
+   * number of bytes saved
+   */
+  size_t compress_cold();
+
+  /**
+   * Enables anti-caching for this table: tuples which have not been read
+   * for at least min_idle_ticks ticker ticks are moved out to the
+   * evict_store by evict_cold(), leaving a stub behind. A txn which reads a
+   * stub faults the record back in and aborts, so that its retry finds the
+   * record resident. 0 disables. Requires TUPLE_ANTI_CACHING and an open
+   * evict_store
+   */
+  inline void
+  set_eviction(uint8_t min_idle_ticks)
+  {
+    eviction_idle_ticks = min_idle_ticks;
+  }
+
+  inline bool
+  is_eviction_enabled() const
+  {
+    return eviction_idle_ticks;
+  }
+
+  /**
+   * Background pass which evicts cold tuples. Same concurrency caveats as
+   * compact(). Returns the number of bytes of memory freed
+   */
+  size_t evict_cold();
+
+  /**
+   * NUMA placement: home_cpu(k) (for a keystring_type k) names the cpu whose
+   * allocator region the record for k belongs in, or -1 if it can live
+   * anywhere. Relocates the latest version of each record which lives on a
+   * different numa node than its home- with TUPLE_TRACK_ACCESS, only the
+   * ones read within the last max_idle_ticks ticks. Later versions of a
+   * record stay in its region if rcu::g_sticky_placement is set.
+   *
+   * Same concurrency caveats as compact(). Returns the number of records
+   * moved
+   */
+  template <typename HomeFn>
+  size_t migrate(const HomeFn &home_cpu, uint8_t max_idle_ticks = 255);
+
+  /**
+   * Unlinks the tombstones of committed deletes from the tree as soon as
+   * the protocol says no reader can need them any more, instead of waiting
+   * for the deleting thread's GC to get around to it- until then, every scan
+   * over the deleted range still has to visit (and validate) each one. The
+   * tuples themselves are still freed by the GC.
+   *
+   * Same concurrency caveats as compact(). Returns the number of bytes
+   * handed back to the GC
+   */
+  size_t purge_tombstones();
+
 private:
 
+  struct compact_rewriter {
+    constexpr compact_rewriter(size_type min_slack_bytes)
+      : min_slack_bytes(min_slack_bytes) {}
+    inline bool
+    is_candidate(const keystring_type &k, const dbtuple *tuple) const
+    {
+      return tuple->is_compaction_candidate(min_slack_bytes);
+    }
+    inline dbtuple *
+    rewrite(const keystring_type &k, dbtuple *tuple) const
+    {
+      // same version, value and chain as tuple, only smaller
+      return dbtuple::alloc(tuple->version, tuple, true);
+    }
+    inline size_t
+    on_rewrite(const dbtuple *tuple, const dbtuple *rep) const
+    {
+      INVARIANT(rep->alloc_size < tuple->alloc_size);
+      const size_t nbytes = tuple->alloc_size - rep->alloc_size;
+      ++dbtuple::g_evt_dbtuple_compactions;
+      dbtuple::g_evt_dbtuple_compaction_bytes_reclaimed += nbytes;
+      return nbytes;
+    }
+    const size_type min_slack_bytes;
+  };
+
+#ifdef TUPLE_COLD_COMPRESSION
+  struct cold_compress_rewriter {
+    constexpr cold_compress_rewriter(uint8_t min_idle_ticks)
+      : min_idle_ticks(min_idle_ticks) {}
+    inline bool
+    is_candidate(const keystring_type &k, const dbtuple *tuple) const
+    {
+      return tuple->is_cold_compression_candidate(min_idle_ticks);
+    }
+    inline dbtuple *
+    rewrite(const keystring_type &k, dbtuple *tuple) const
+    {
+      return dbtuple::alloc_compressed(tuple);
+    }
+    inline size_t
+    on_rewrite(const dbtuple *tuple, const dbtuple *rep) const
+    {
+      INVARIANT(rep->alloc_size < tuple->alloc_size);
+      const size_t nbytes = tuple->alloc_size - rep->alloc_size;
+      ++dbtuple::g_evt_dbtuple_cold_compressions;
+      dbtuple::g_evt_dbtuple_cold_compression_bytes_saved += nbytes;
+      return nbytes;
+    }
+    const uint8_t min_idle_ticks;
+  };
+#endif
+
+#ifdef TUPLE_ANTI_CACHING
+  struct evict_rewriter {
+    constexpr evict_rewriter(uint8_t min_idle_ticks)
+      : min_idle_ticks(min_idle_ticks) {}
+    inline bool
+    is_candidate(const keystring_type &k, const dbtuple *tuple) const
+    {
+      return tuple->is_eviction_candidate(min_idle_ticks);
+    }
+    inline dbtuple *
+    rewrite(const keystring_type &k, dbtuple *tuple) const
+    {
+      return dbtuple::alloc_evicted(tuple);
+    }
+    inline size_t
+    on_rewrite(const dbtuple *tuple, const dbtuple *rep) const
+    {
+      INVARIANT(rep->alloc_size < tuple->alloc_size);
+      const size_t nbytes = tuple->alloc_size - rep->alloc_size;
+      ++dbtuple::g_evt_dbtuple_evictions;
+      dbtuple::g_evt_dbtuple_eviction_bytes_saved += nbytes;
+      return nbytes;
+    }
+    const uint8_t min_idle_ticks;
+  };
+#endif
+
+  // not really a rewriter- purge_tombstones() only borrows the candidate
+  // scan from rewrite_tuples()
+  struct tombstone_filter {
+    inline bool
+    is_candidate(const keystring_type &k, const dbtuple *tuple) const
+    {
+      return tuple->is_tombstone() &&
+             base_txn_btree_handler<Transaction>::can_purge_tombstone(tuple);
+    }
+  };
+
+  template <typename HomeFn>
+  struct migrate_rewriter {
+    constexpr migrate_rewriter(const HomeFn &home_cpu, uint8_t max_idle_ticks)
+      : home_cpu(&home_cpu), max_idle_ticks(max_idle_ticks) {}
+    inline bool
+    is_candidate(const keystring_type &k, const dbtuple *tuple) const
+    {
+      // only plain records can be copied w/ dbtuple::alloc()
+      if (!tuple->is_latest() || tuple->is_deleting() ||
+          tuple->is_compressed() || tuple->is_evicted() ||
+          tuple->version == dbtuple::MAX_TID ||
+          !::allocator::ManagesPointer(tuple))
+        return false;
+#ifdef TUPLE_TRACK_ACCESS
+      if (tuple->idle_ticks() > max_idle_ticks)
+        return false;
+#endif
+      const ssize_t home = (*home_cpu)(k);
+      return home != -1 &&
+             ::allocator::PointerToNode(tuple) != ::allocator::CpuToNode(home);
+    }
+    inline dbtuple *
+    rewrite(const keystring_type &k, dbtuple *tuple) const
+    {
+      scoped_placement_hint h((*home_cpu)(k));
+      return dbtuple::alloc(tuple->version, tuple, true);
+    }
+    inline size_t
+    on_rewrite(const dbtuple *tuple, const dbtuple *rep) const
+    {
+      ++dbtuple::g_evt_dbtuple_migrations;
+      return 1;
+    }
+    const HomeFn *const home_cpu;
+    const uint8_t max_idle_ticks;
+  };
+
+#ifdef TUPLE_ANTI_CACHING
+  // brings stub back into memory, then aborts t (H-Store style: we do not
+  // want to have to reason about what t read while we were doing IO)
+  template <typename Traits>
+  void fault_in_and_abort(Transaction<Traits> &t,
+                          const std::string &k,
+                          const dbtuple *stub);
+#endif
+
+  template <typename Rewriter>
+  struct rewrite_scan_callback {
+    rewrite_scan_callback(const Rewriter &rw, size_t max_candidates)
+      : rw(&rw), max_candidates(max_candidates) {}
+    inline bool
+    operator()(const keystring_type &k, typename concurrent_btree::value_type v)
+    {
+      const dbtuple * const tuple = reinterpret_cast<const dbtuple *>(v);
+      // racy pre-filter, re-checked under the lock
+      if (rw->is_candidate(k, tuple))
+        candidates.emplace_back(std::string(k.data(), k.length()), v);
+      // always remember where we stopped, so the next batch can resume
+      last_key.assign(k.data(), k.length());
+      return candidates.size() < max_candidates;
+    }
+    const Rewriter *const rw;
+    const size_t max_candidates;
+    std::string last_key;
+    std::vector< std::pair<std::string, typename concurrent_btree::value_type> > candidates;
+  };
+
+  // swaps every latest tuple selected by rw for its rewritten copy, returning
+  // the sum of rw.on_rewrite()
+  template <typename Rewriter>
+  size_t rewrite_tuples(const Rewriter &rw);
+
+  template <typename Rewriter>
+  size_t rewrite_tuple(const Rewriter &rw, const std::string &k, dbtuple *tuple);
+
+  // swaps the tree entry for k from tuple (locked, latest) to rep, and
+  // retires tuple
+  void replace_tuple(const std::string &k, dbtuple *tuple, dbtuple *rep);
+
   struct purge_tree_walker : public concurrent_btree::tree_walk_callback {
     virtual void on_node_begin(const typename concurrent_btree::node_opaque_t *n);
     virtual void on_node_success();
@@ -143,11 +496,12 @@ protected:
             typename KeyReader, typename ValueReader>
   struct txn_search_range_callback : public concurrent_btree::low_level_search_range_callback {
     constexpr txn_search_range_callback(
+          base_txn_btree *btr,
           Transaction<Traits> *t,
           Callback *caller_callback,
           KeyReader *key_reader,
           ValueReader *value_reader)
-      : t(t), caller_callback(caller_callback),
+      : btr(btr), t(t), caller_callback(caller_callback),
         key_reader(key_reader), value_reader(value_reader) {}
 
     virtual void on_resp_node(const typename concurrent_btree::node_opaque_t *n, uint64_t version);
@@ -155,6 +509,7 @@ protected:
                         const typename concurrent_btree::node_opaque_t *n, uint64_t version);
 
   private:
+    base_txn_btree *const btr;
     Transaction<Traits> *const t;
     Callback *const caller_callback;
     KeyReader *const key_reader;
@@ -201,8 +556,11 @@ protected:
 
   concurrent_btree underlying_btree;
   size_type value_size_hint;
+  bool mostly_append;
   std::string name;
   bool been_destructed;
+  uint8_t cold_compression_idle_ticks;
+  uint8_t eviction_idle_ticks;
 };
 
 namespace private_ {
@@ -230,6 +588,12 @@ base_txn_btree<Transaction, P>::do_search(
   const bool found = this->underlying_btree.search(varkey(*key_str), underlying_v, &search_info);
   if (found) {
     const dbtuple * const tuple = reinterpret_cast<const dbtuple *>(underlying_v);
+#ifdef TUPLE_ANTI_CACHING
+    if (unlikely(tuple->is_evicted()))
+      fault_in_and_abort(t, *key_str, tuple);
+#endif
+    t.note_read_key(tuple, &this->underlying_btree,
+                    key_str->data(), key_str->size());
     return t.do_tuple_read(tuple, value_reader);
   } else {
     // not found, add to absent_set
@@ -257,6 +621,240 @@ base_txn_btree<Transaction, P>::unsafe_purge(bool dump_stats)
 #endif
 }
 
+template <template <typename> class Transaction, typename P>
+std::vector<std::string>
+base_txn_btree<Transaction, P>::split_range(
+    const std::string &lower, const std::string *upper, size_t nparts) const
+{
+  std::vector<std::string> ret(1, lower);
+  if (nparts < 2)
+    return ret;
+  // oversample, since only the samples within the range are of any use
+  static const size_t OversampleFactor = 8;
+  std::vector<std::string> samples =
+    underlying_btree.sample_separators(OversampleFactor * nparts);
+  auto it = std::upper_bound(samples.begin(), samples.end(), lower);
+  auto it_end = upper ?
+    std::lower_bound(it, samples.end(), *upper) : samples.end();
+  const size_t n = it_end - it;
+  for (size_t i = 1; i < nparts; i++) {
+    const size_t idx = (i * n) / nparts;
+    if (idx < n && (ret.size() == 1 || ret.back() != *(it + idx)))
+      ret.push_back(*(it + idx));
+  }
+  return ret;
+}
+
+template <template <typename> class Transaction, typename P>
+template <typename InputIterator>
+size_t
+base_txn_btree<Transaction, P>::bulk_load(InputIterator begin, InputIterator end)
+{
+  ALWAYS_ASSERT(!been_destructed);
+  // same reasoning as RewriteBatchSize- don't sit in one RCU region for
+  // the whole load
+  static const size_t LoadBatchSize = 1024;
+  const tid_t t = base_txn_btree_handler<Transaction>::load_tid();
+  size_t ret = 0;
+  while (begin != end) {
+    scoped_rcu_region guard;
+    for (size_t n = 0; n < LoadBatchSize && begin != end; ++n, ++begin) {
+      const std::string &k = begin->first;
+      const std::string &v = begin->second;
+      INVARIANT(!v.empty()); // an empty record reads as deleted
+      dbtuple * const tuple = dbtuple::alloc_first(v.size(), false);
+      NDB_MEMCPY(tuple->get_value_start(), v.data(), v.size());
+      tuple->version = t;
+#ifdef TUPLE_CHECK_KEY
+      tuple->key.assign(k.data(), k.size());
+      tuple->tree = (void *) &underlying_btree;
+#endif
+      if (unlikely(!underlying_btree.insert_if_absent(
+              varkey(k), (typename concurrent_btree::value_type) tuple))) {
+        // never published, but clear_latest() wants the lock held
+        tuple->lock(false);
+        tuple->clear_latest();
+        tuple->unlock();
+        dbtuple::release_no_rcu(tuple);
+        continue;
+      }
+      ret++;
+    }
+  }
+  return ret;
+}
+
+template <template <typename> class Transaction, typename P>
+size_t
+base_txn_btree<Transaction, P>::compact(size_type min_slack_bytes)
+{
+  return rewrite_tuples(compact_rewriter(min_slack_bytes));
+}
+
+template <template <typename> class Transaction, typename P>
+size_t
+base_txn_btree<Transaction, P>::compress_cold()
+{
+#ifdef TUPLE_COLD_COMPRESSION
+  if (!cold_compression_idle_ticks)
+    return 0;
+  return rewrite_tuples(cold_compress_rewriter(cold_compression_idle_ticks));
+#else
+  return 0;
+#endif
+}
+
+template <template <typename> class Transaction, typename P>
+size_t
+base_txn_btree<Transaction, P>::evict_cold()
+{
+#ifdef TUPLE_ANTI_CACHING
+  if (!eviction_idle_ticks)
+    return 0;
+  return rewrite_tuples(evict_rewriter(eviction_idle_ticks));
+#else
+  return 0;
+#endif
+}
+
+template <template <typename> class Transaction, typename P>
+template <typename HomeFn>
+size_t
+base_txn_btree<Transaction, P>::migrate(
+    const HomeFn &home_cpu, uint8_t max_idle_ticks)
+{
+  return rewrite_tuples(migrate_rewriter<HomeFn>(home_cpu, max_idle_ticks));
+}
+
+template <template <typename> class Transaction, typename P>
+size_t
+base_txn_btree<Transaction, P>::purge_tombstones()
+{
+  ALWAYS_ASSERT(!been_destructed);
+  static const size_t PurgeBatchSize = 1024;
+  tombstone_filter f;
+  size_t ret = 0;
+  std::string lower;
+  for (;;) {
+    scoped_rcu_region guard;
+    rewrite_scan_callback<tombstone_filter> c(f, PurgeBatchSize);
+    underlying_btree.search_range(varkey(lower), nullptr, c);
+    for (auto &p : c.candidates) {
+      dbtuple * const tuple = reinterpret_cast<dbtuple *>(p.second);
+      // the GC also only unlinks a tombstone while holding its lock, and
+      // clears its latest bit when it does- so once we have the lock, a
+      // tombstone which is still latest is still in the tree
+      ::lock_guard<dbtuple> lg(tuple, true);
+      if (!f.is_candidate(keystring_type(p.first.data(), p.first.length()), tuple))
+        continue;
+      typename concurrent_btree::value_type removed = 0;
+      const bool did_remove = underlying_btree.remove(varkey(p.first), &removed);
+      ALWAYS_ASSERT(did_remove);
+      INVARIANT(removed == p.second);
+      // txns which read the tombstone now fail validation, and the GC
+      // entry for it frees the tuple instead of removing it again
+      tuple->clear_latest();
+      ++dbtuple::g_evt_dbtuple_tombstone_purges;
+      ret += sizeof(dbtuple) + tuple->alloc_size;
+    }
+    if (c.candidates.size() < PurgeBatchSize)
+      break;
+    lower = util::next_key(c.last_key);
+  }
+  return ret;
+}
+
+#ifdef TUPLE_ANTI_CACHING
+template <template <typename> class Transaction, typename P>
+template <typename Traits>
+void
+base_txn_btree<Transaction, P>::fault_in_and_abort(
+    Transaction<Traits> &t, const std::string &k, const dbtuple *stub)
+{
+  INVARIANT(rcu::s_instance.in_rcu_region());
+  {
+    dbtuple * const px = const_cast<dbtuple *>(stub);
+    // see rewrite_tuple() for why holding the lock is enough
+    ::lock_guard<dbtuple> lg(px, true);
+    // someone else may have beaten us to it
+    if (px->is_latest() && px->is_evicted())
+      replace_tuple(k, px, dbtuple::alloc_resident(px));
+  }
+  const transaction_base::abort_reason r =
+    transaction_base::ABORT_REASON_EVICTED_READ;
+  t.abort_impl(r);
+  throw transaction_abort_exception(r);
+}
+#endif
+
+template <template <typename> class Transaction, typename P>
+template <typename Rewriter>
+size_t
+base_txn_btree<Transaction, P>::rewrite_tuples(const Rewriter &rw)
+{
+  ALWAYS_ASSERT(!been_destructed);
+  // bound the number of tuples swapped per RCU region, so we do not hold
+  // back reclamation for an entire table's worth of garbage
+  static const size_t RewriteBatchSize = 1024;
+  size_t ret = 0;
+  std::string lower;
+  for (;;) {
+    scoped_rcu_region guard;
+    rewrite_scan_callback<Rewriter> c(rw, RewriteBatchSize);
+    underlying_btree.search_range(varkey(lower), nullptr, c);
+    for (auto &p : c.candidates)
+      ret += rewrite_tuple(
+          rw, p.first, reinterpret_cast<dbtuple *>(p.second));
+    if (c.candidates.size() < RewriteBatchSize)
+      break;
+    lower = util::next_key(c.last_key);
+  }
+  return ret;
+}
+
+template <template <typename> class Transaction, typename P>
+template <typename Rewriter>
+size_t
+base_txn_btree<Transaction, P>::rewrite_tuple(
+    const Rewriter &rw, const std::string &k, dbtuple *tuple)
+{
+  INVARIANT(rcu::s_instance.in_rcu_region());
+  // holding the lock on a latest, non-deleted, committed tuple guarantees
+  // nobody else can unlink it from the tree: commit only replaces tuples it
+  // has locked, and the GC only removes deleted ones
+  ::lock_guard<dbtuple> lg(tuple, true);
+  const keystring_type kstr(k.data(), k.length());
+  if (!rw.is_candidate(kstr, tuple))
+    return 0;
+  dbtuple * const rep = rw.rewrite(kstr, tuple);
+  if (!rep)
+    return 0;
+  const size_t ret = rw.on_rewrite(tuple, rep);
+  replace_tuple(k, tuple, rep);
+  return ret;
+}
+
+template <template <typename> class Transaction, typename P>
+void
+base_txn_btree<Transaction, P>::replace_tuple(
+    const std::string &k, dbtuple *tuple, dbtuple *rep)
+{
+  INVARIANT(tuple->is_locked());
+  INVARIANT(tuple->is_latest());
+  INVARIANT(rep->is_latest());
+  INVARIANT(rep->version == tuple->version);
+  typename concurrent_btree::value_type old_v = 0;
+  if (underlying_btree.insert(
+        varkey(k), (typename concurrent_btree::value_type) rep, &old_v, NULL))
+    // should already exist in tree
+    INVARIANT(false);
+  INVARIANT(old_v == (typename concurrent_btree::value_type) tuple);
+  // readers/writers still holding tuple now see a non-latest version and
+  // will abort; tuple is freed once they have all left their RCU regions
+  tuple->clear_latest();
+  dbtuple::release(tuple);
+}
+
 template <template <typename> class Transaction, typename P>
 void
 base_txn_btree<Transaction, P>::purge_tree_walker::on_node_begin(const typename concurrent_btree::node_opaque_t *n)
@@ -405,6 +1003,11 @@ base_txn_btree<Transaction, P>
                     << ", version=" << version << ">" << std::endl
                     << "  " << *((dbtuple *) v) << std::endl);
   const dbtuple * const tuple = reinterpret_cast<const dbtuple *>(v);
+#ifdef TUPLE_ANTI_CACHING
+  if (unlikely(tuple->is_evicted()))
+    btr->fault_in_and_abort(*t, std::string(k.data(), k.length()), tuple);
+#endif
+  t->note_read_key(tuple, &btr->underlying_btree, k.data(), k.length());
   if (t->do_tuple_read(tuple, *value_reader))
     return caller_callback->invoke(
         (*key_reader)(k), value_reader->results());
@@ -445,7 +1048,7 @@ base_txn_btree<Transaction, P>::do_search_range_call(
     return;
 
   txn_search_range_callback<Traits, Callback, KeyReader, ValueReader> c(
-			&t, &callback, &key_reader, &value_reader);
+			this, &t, &callback, &key_reader, &value_reader);
 
   varkey uppervk;
   if (upper_str)
@@ -481,7 +1084,7 @@ base_txn_btree<Transaction, P>::do_rsearch_range_call(
     return;
 
   txn_search_range_callback<Traits, Callback, KeyReader, ValueReader> c(
-			&t, &callback, &key_reader, &value_reader);
+			this, &t, &callback, &key_reader, &value_reader);
 
   varkey lowervk;
   if (lower_str)
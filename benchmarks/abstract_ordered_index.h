@@ -5,6 +5,7 @@
 #include <string>
 #include <utility>
 #include <map>
+#include <vector>
 #include "../masstree/str.hh"
 
 #include "../macros.h"
@@ -275,10 +276,66 @@ public:
   } 
 
   /**
-   * Only an estimate, not transactional!
+   * Only an estimate, not transactional! Should be cheap enough to call
+   * often
    */
   virtual size_t size() const = 0;
 
+  /**
+   * Exact when there are no concurrent modifications, but may scan the
+   * whole index. Default implementation is size()
+   */
+  virtual size_t exact_size() const { return size(); }
+
+  /**
+   * Re-packs over-allocated records and unlinks deleted ones which no
+   * reader can see any more, returning the number of bytes reclaimed. Safe to call concurrently with txns, but may cause them
+   * to abort. Default implementation does nothing
+   */
+  virtual size_t compact() { return 0; }
+
+  /**
+   * Records not read for at least min_idle_ticks ticker ticks are kept
+   * compressed by compact(). 0 disables. Default implementation ignores
+   * the hint
+   */
+  virtual void set_cold_compression(unsigned min_idle_ticks) {}
+
+  /**
+   * Records not read for at least min_idle_ticks ticker ticks are evicted
+   * to disk by compact(). 0 disables. Default implementation ignores the
+   * hint
+   */
+  virtual void set_eviction(unsigned min_idle_ticks) {}
+
+  /**
+   * Moves the records of this index which do not live on home_cpu's numa
+   * node there, returning the number moved. Same caveats as compact().
+   * Default implementation does nothing
+   */
+  virtual size_t migrate(ssize_t home_cpu) { return 0; }
+
+  /**
+   * Loads records (best sorted by key) outside of any txn. Keys which are
+   * already present are skipped, so returns the number actually loaded, or
+   * -1, having loaded nothing, if unsupported- callers should then fall
+   * back to inserting with txns. Default implementation is unsupported
+   */
+  virtual ssize_t
+  bulk_load(const std::vector<std::pair<std::string, std::string>> &records)
+  {
+    return -1;
+  }
+
+  /**
+   * Warm restart: records this index's tree among the allocator's roots,
+   * and adopts the tree recorded by an earlier process. Both return false
+   * if unsupported (or, for reattach_root(), if there is nothing to adopt).
+   * Not thread safe
+   */
+  virtual bool save_root() { return false; }
+  virtual bool reattach_root() { return false; }
+
   /**
    * Not thread safe for now
    */
@@ -4,6 +4,9 @@
 #include <vector>
 #include <utility>
 #include <string>
+#include <cmath>
+#include <functional>
+#include <memory>
 
 #include <stdlib.h>
 #include <sched.h>
@@ -15,6 +18,9 @@
 #include "../counter.h"
 #include "../scopedperf.hh"
 #include "../allocator.h"
+#include "../stats_server.h"
+#include "../commit_trace.h"
+#include "../conflict_sampler.h"
 #include "sto/Transaction.hh"
 
 #ifdef USE_JEMALLOC
@@ -39,12 +45,25 @@ uint64_t runtime = 30;
 uint64_t ops_per_worker = 0;
 int run_mode = RUNMODE_TIME;
 int enable_parallel_loading = false;
+int enable_bulk_loading = false;
 int pin_cpus = 0;
 int slow_exit = 0;
 int retry_aborted_transaction = 0;
 int no_reset_counters = 0;
 int backoff_aborted_transaction = 0;
 int use_hashtable = 0;
+int hashtable_scans = 0;
+int use_leaf_cache = 0;
+uint64_t compaction_interval_ms = 0;
+unsigned cold_compression_idle_ticks = 0;
+unsigned eviction_idle_ticks = 0;
+int numa_placement = 0;
+double open_loop_rate = 0.0;
+int poisson_arrivals = 0;
+uint64_t sample_interval_ms = 0;
+string sample_file;
+string commit_trace_file = "commit_trace.out";
+int hw_counters_enabled = 0;
 
 template <typename T>
 static void
@@ -120,19 +139,71 @@ bench_worker::run()
   scoped_db_thread_ctx ctx(db, false);
   const workload_desc_vec workload = get_workload();
   txn_counts.resize(workload.size());
+  commit_latency_hists.resize(workload.size());
+  e2e_latency_hists.resize(workload.size());
+  // opened here, so they count this thread. XXX: the two reads per attempt
+  // are syscalls (~1us each)- kept out of the latencies, but short txns
+  // will still see fewer commits/sec
+  unique_ptr<hw_counters> hwc;
+  hw_counters::values hwc_before, hwc_after;
+  if (hw_counters_enabled) {
+    hwc.reset(new hw_counters);
+    hw_counter_totals.resize(workload.size());
+  }
+  // open loop: each worker takes an equal share of the target rate, and its
+  // txns are due on a fixed schedule whether or not the previous one has
+  // finished. end to end latency counts from when a txn was due, not from
+  // when we got around to it, so falling behind shows up as latency
+  // (instead of as fewer, fast samples- coordinated omission)
+  const double mean_gap_us = open_loop_rate > 0.0 ?
+    1000000.0 * double(nthreads) / open_loop_rate : 0.0;
+  // separate from r, so that arrivals do not perturb the txn mix
+  util::fast_random arrival_r(r.next());
   barrier_a->count_down();
   barrier_b->wait_for();
+  // the schedule is kept in fractional usecs since start_us, and only
+  // rounded to compare against the clock- truncating every gap instead
+  // would run the schedule fast (by up to 1us per txn)
+  const uint64_t start_us = timer::cur_usec();
+  double due_offset_us = 0.0;
+  uint64_t next_due_us = start_us;
   while (running && (run_mode != RUNMODE_OPS || ntxn_commits < ops_per_worker)) {
+    if (mean_gap_us > 0.0) {
+      due_offset_us += poisson_arrivals ?
+        -log(1.0 - arrival_r.next_uniform()) * mean_gap_us : mean_gap_us;
+      next_due_us = start_us + uint64_t(due_offset_us);
+      for (uint64_t now = timer::cur_usec();
+           now < next_due_us && running;
+           now = timer::cur_usec()) {
+        if (next_due_us - now > 100)
+          usleep(next_due_us - now - 50);
+        else
+          nop_pause();
+      }
+    }
     double d = r.next_uniform();
     for (size_t i = 0; i < workload.size(); i++) {
       if ((i + 1) == workload.size() || d < workload[i].frequency) {
+        const uint64_t e2e_start_us =
+          mean_gap_us > 0.0 ? next_due_us : timer::cur_usec();
       retry:
-        timer t;
         const unsigned long old_seed = r.get_seed();
+        // the counter reads stay out of the latencies
+        if (hwc)
+          hwc->read(hwc_before);
+        const uint64_t txn_start_us = timer::cur_usec();
         const auto ret = workload[i].fn(this);
+        const uint64_t txn_end_us = timer::cur_usec();
+        if (hwc) {
+          hwc->read(hwc_after);
+          hw_counter_totals[i] += hwc_after - hwc_before;
+        }
         if (likely(ret.first)) {
           ++ntxn_commits;
-          latency_numer_us += t.lap();
+          const uint64_t lat_us = txn_end_us - txn_start_us;
+          latency_numer_us += lat_us;
+          commit_latency_hists[i].record(lat_us);
+          e2e_latency_hists[i].record(txn_end_us - e2e_start_us);
           backoff_shifts >>= 1;
         } else {
           ++ntxn_aborts;
@@ -166,9 +237,19 @@ bench_worker::run()
 void
 bench_runner::run()
 {
-  // load data
-  const vector<bench_loader *> loaders = make_loaders();
-  {
+  // load data- unless the tables came back with a reattached heap
+  const bool warm = ::allocator::IsWarmRestart();
+  const vector<bench_loader *> loaders =
+    warm ? vector<bench_loader *>() : make_loaders();
+  if (warm) {
+    scoped_timer t("reattaching", verbose);
+    for (auto &p : open_tables)
+      if (!p.second->reattach_root()) {
+        cerr << "[ERROR] table " << p.first
+             << " cannot be reattached from the heap" << endl;
+        ALWAYS_ASSERT(false);
+      }
+  } else {
     spin_barrier b(loaders.size());
     const pair<uint64_t, uint64_t> mem_info_before = get_system_memory_info();
     {
@@ -202,6 +283,7 @@ bench_runner::run()
 
   if (!no_reset_counters) {
     event_counter::reset_all_counters(); // XXX: for now - we really should have a before/after loading
+    conflict_sampler::reset();
     PERF_EXPR(scopedperf::perfsum_base::resetall());
   }
   {
@@ -228,6 +310,13 @@ bench_runner::run()
 
   const pair<uint64_t, uint64_t> mem_info_before = get_system_memory_info();
 
+  if (cold_compression_idle_ticks)
+    for (auto &p : open_tables)
+      p.second->set_cold_compression(cold_compression_idle_ticks);
+  if (eviction_idle_ticks)
+    for (auto &p : open_tables)
+      p.second->set_eviction(eviction_idle_ticks);
+
   const vector<bench_worker *> workers = make_workers();
   ALWAYS_ASSERT(!workers.empty());
   Transaction::clear_stats();
@@ -238,6 +327,16 @@ bench_runner::run()
   barrier_a.wait_for(); // wait for all threads to start up
   timer t, t_nosync;
   barrier_b.count_down(); // bombs away!
+  thread compactor;
+  if (compaction_interval_ms) {
+    compactor_running = true;
+    compactor = thread(&bench_runner::compaction_loop, this);
+  }
+  thread sampler;
+  if (sample_interval_ms) {
+    sampler_running = true;
+    sampler = thread(&bench_runner::sampler_loop, this, cref(workers));
+  }
   if (run_mode == RUNMODE_TIME) {
     sleep(runtime);
     running = false;
@@ -245,6 +344,16 @@ bench_runner::run()
   __sync_synchronize();
   for (size_t i = 0; i < nthreads; i++)
     workers[i]->join();
+  if (compactor.joinable()) {
+    compactor_running = false;
+    __sync_synchronize();
+    compactor.join();
+  }
+  if (sampler.joinable()) {
+    sampler_running = false;
+    __sync_synchronize();
+    sampler.join();
+  }
   const unsigned long elapsed_nosync = t_nosync.lap();
   db->do_txn_finish(); // waits for all worker txns to persist
   //  usleep(100000);
@@ -267,6 +376,13 @@ bench_runner::run()
   // not == b/c persisted_info does not count read-only txns
   ALWAYS_ASSERT(n_commits >= get<1>(persisted_info));
 
+  if (commit_trace::g_sample_period) {
+    const size_t n = commit_trace::dump(commit_trace_file);
+    if (verbose)
+      cerr << "wrote " << n << " sampled commits to " << commit_trace_file
+           << endl;
+  }
+
   const double elapsed_nosync_sec = double(elapsed_nosync) / 1000000.0;
   const double agg_nosync_throughput = double(n_commits) / elapsed_nosync_sec;
   const double avg_nosync_per_core_throughput = agg_nosync_throughput / double(workers.size());
@@ -298,6 +414,18 @@ bench_runner::run()
     size_delta += workers[i]->get_size_delta();
   }
 
+  bench_worker::latency_hist_map agg_commit_hists, agg_e2e_hists;
+  for (size_t i = 0; i < workers.size(); i++) {
+    for (auto &p : workers[i]->get_commit_latency_hists())
+      agg_commit_hists[p.first].merge(p.second);
+    for (auto &p : workers[i]->get_e2e_latency_hists())
+      agg_e2e_hists[p.first].merge(p.second);
+  }
+  bench_worker::hw_counter_map agg_hw_counters;
+  for (size_t i = 0; i < workers.size(); i++)
+    for (auto &p : workers[i]->get_hw_counter_totals())
+      agg_hw_counters[p.first] += p.second;
+
   if (verbose) {
     const pair<uint64_t, uint64_t> mem_info_after = get_system_memory_info();
     const int64_t delta = int64_t(mem_info_before.first) - int64_t(mem_info_after.first); // free mem
@@ -346,10 +474,51 @@ bench_runner::run()
     cerr << "agg_abort_rate: " << agg_abort_rate << " aborts/sec" << endl;
     cerr << "avg_per_core_abort_rate: " << avg_per_core_abort_rate << " aborts/sec/core" << endl;
     cerr << "txn breakdown: " << format_list(agg_txn_counts.begin(), agg_txn_counts.end()) << endl;
+    cerr << "--- txn latency (us) ---" << endl;
+    for (auto &p : agg_commit_hists) {
+      cerr << p.first << " commit: ";
+      p.second.print_percentiles(cerr);
+      cerr << endl;
+      cerr << p.first << " e2e: ";
+      agg_e2e_hists[p.first].print_percentiles(cerr);
+      cerr << endl;
+    }
+    if (!agg_hw_counters.empty()) {
+      // per committed txn, so the cost of aborted attempts is included
+      cerr << "--- hw counters (per txn) ---" << endl;
+      for (auto &p : agg_hw_counters) {
+        const uint64_t *v = &p.second.v_[0];
+        const double ntxns = max(agg_txn_counts[p.first], size_t(1));
+        cerr << p.first << ": ipc="
+             << (v[hw_counters::EV_CYCLES] ?
+                 double(v[hw_counters::EV_INSTRUCTIONS]) /
+                 double(v[hw_counters::EV_CYCLES]) : 0.0);
+        for (size_t e = 0; e < hw_counters::NEVENTS; e++)
+          cerr << " " << hw_counters::EventStr(hw_counters::event(e)) << "="
+               << double(v[e]) / ntxns;
+        cerr << endl;
+      }
+    }
+    if (conflict_sampler::g_enabled) {
+      cerr << "--- top conflicting keys ---" << endl;
+      for (auto &p : conflict_sampler::top(10))
+        for (auto &e : p.second)
+          cerr << p.first << " " << hexify(e.key_) << ": " << e.count_
+               << " (error <= " << e.error_ << ")" << endl;
+    }
     cerr << "--- system counters (for benchmark) ---" << endl;
+    const map<string, event_hist_counter::histogram_type> hists =
+      event_hist_counter::get_all_histograms();
     for (map<string, counter_data>::iterator it = ctrs.begin();
-         it != ctrs.end(); ++it)
-      cerr << it->first << ": " << it->second << endl;
+         it != ctrs.end(); ++it) {
+      cerr << it->first << ": " << it->second;
+      auto hit = hists.find(it->first);
+      if (hit != hists.end()) {
+        cerr << ", ";
+        hit->second.print_percentiles(cerr);
+      }
+      cerr << endl;
+    }
     cerr << "--- perf counters (if enabled, for benchmark) ---" << endl;
     PERF_EXPR(scopedperf::perfsum_base::printall());
     cerr << "--- allocator stats ---" << endl;
@@ -381,6 +550,22 @@ bench_runner::run()
     //it->second->print_stats();
   }
 
+  if (::allocator::IsPersistent()) {
+    // gc and rcu frees are queued per thread. the workers, loaders and the
+    // compactor have drained theirs on the way out (the sampler only reads),
+    // so once ours is empty too, nothing can write to the heap anymore
+    rcu::s_instance.drain();
+    for (auto &p : open_tables)
+      ALWAYS_ASSERT(p.second->save_root());
+    ::allocator::SetRoot("ticker", ticker::s_instance.global_current_tick());
+    const bool saved = ::allocator::Shutdown();
+    if (verbose)
+      cerr << "heap " << (saved ? "saved" : "NOT saved")
+           << " for a warm restart" << endl;
+    // tearing down the tables would free into the saved heap
+    return;
+  }
+
   if (!slow_exit)
     return;
 
@@ -401,6 +586,97 @@ bench_runner::run()
   delete_pointers(workers);
 }
 
+void
+bench_runner::compaction_loop()
+{
+  size_t reclaimed = 0, migrated = 0;
+  while (compactor_running) {
+    usleep(compaction_interval_ms * 1000);
+    if (!compactor_running)
+      break;
+    for (auto &p : open_tables)
+      reclaimed += p.second->compact();
+    if (numa_placement)
+      migrated += migrate_tables();
+  }
+  // our rcu queue is not run by anyone once we are gone, see
+  // txn_epoch_sync<>::thread_end() for the worker side
+  if (::allocator::IsPersistent())
+    rcu::s_instance.drain();
+  if (verbose) {
+    cerr << "compaction reclaimed " << reclaimed << " bytes" << endl;
+    if (numa_placement)
+      cerr << "migrated " << migrated << " records to their home node" << endl;
+  }
+}
+
+void
+bench_runner::sampler_loop(const vector<bench_worker *> &workers)
+{
+  // the per reason abort counts are only there w/ ENABLE_EVENT_COUNTERS
+  vector<string> abort_reasons;
+  for (auto &p : event_counter::get_all_counters())
+    if (p.first.compare(0, 13, "ABORT_REASON_") == 0 &&
+        p.first != "ABORT_REASON_NONE")
+      abort_reasons.push_back(p.first);
+
+  ostringstream hdr;
+  hdr << "# timestamp_us elapsed_ms commits aborts persisted alloc_bytes";
+  for (auto &n : abort_reasons)
+    hdr << " " << n;
+  stats_server::set_sample_header(hdr.str());
+  ofstream ofs;
+  if (!sample_file.empty()) {
+    ofs.open(sample_file.c_str());
+    ALWAYS_ASSERT(ofs);
+    ofs << hdr.str() << endl;
+  }
+
+  // all columns but alloc_bytes are deltas from the previous sample. the
+  // worker counters are read racily, which is fine for a time series
+  vector<uint64_t> prev(3 + abort_reasons.size(), 0), cur(prev.size());
+  const auto take = [&](vector<uint64_t> &v) {
+    v[0] = v[1] = 0;
+    for (auto w : workers) {
+      v[0] += w->get_ntxn_commits();
+      v[1] += w->get_ntxn_aborts();
+    }
+    v[2] = get<0>(db->get_ntxn_persisted());
+    for (size_t i = 0; i < abort_reasons.size(); i++) {
+      counter_data d;
+      v[3 + i] = event_counter::stat(abort_reasons[i], d) ? d.count_ : 0;
+    }
+  };
+  take(prev);
+
+  const uint64_t interval_us = sample_interval_ms * 1000;
+  const uint64_t start_us = timer::cur_usec();
+  uint64_t next_us = start_us + interval_us;
+  while (sampler_running) {
+    // sleep towards a fixed schedule, so the samples don't drift
+    const uint64_t now_us = timer::cur_usec();
+    if (now_us < next_us) {
+      usleep(min(next_us - now_us, uint64_t(100000)));
+      continue;
+    }
+    next_us += interval_us;
+    take(cur);
+    ostringstream line;
+    line << now_us << " " << (now_us - start_us) / 1000;
+    for (size_t i = 0; i < 3; i++)
+      line << " " << (cur[i] - prev[i]);
+    line << " " << ::allocator::GetUsedBytes();
+    for (size_t i = 3; i < cur.size(); i++)
+      line << " " << (cur[i] - prev[i]);
+    prev.swap(cur);
+    stats_server::publish_sample(now_us, line.str());
+    if (ofs.is_open())
+      ofs << line.str() << "\n";
+  }
+  if (ofs.is_open())
+    ofs.flush();
+}
+
 template <typename K, typename V>
 struct map_maxer {
   typedef map<K, V> map_type;
@@ -437,3 +713,35 @@ bench_worker::get_txn_counts() const
     m[workload[i].name] = txn_counts[i];
   return m;
 }
+
+static bench_worker::latency_hist_map
+name_hists(const bench_worker::workload_desc_vec &workload,
+           const vector<log_linear_histogram> &hists)
+{
+  bench_worker::latency_hist_map m;
+  for (size_t i = 0; i < hists.size(); i++)
+    m[workload[i].name].merge(hists[i]);
+  return m;
+}
+
+bench_worker::latency_hist_map
+bench_worker::get_commit_latency_hists() const
+{
+  return name_hists(get_workload(), commit_latency_hists);
+}
+
+bench_worker::latency_hist_map
+bench_worker::get_e2e_latency_hists() const
+{
+  return name_hists(get_workload(), e2e_latency_hists);
+}
+
+bench_worker::hw_counter_map
+bench_worker::get_hw_counter_totals() const
+{
+  hw_counter_map m;
+  const workload_desc_vec workload = get_workload();
+  for (size_t i = 0; i < hw_counter_totals.size(); i++)
+    m[workload[i].name] += hw_counter_totals[i];
+  return m;
+}
@@ -7,6 +7,7 @@
 #include <vector>
 #include <utility>
 #include <string>
+#include <thread>
 
 #include "abstract_db.h"
 #include "../macros.h"
@@ -14,6 +15,8 @@
 #include "../util.h"
 #include "../spinbarrier.h"
 #include "../rcu.h"
+#include "../histogram.h"
+#include "hw_counters.h"
 
 extern void ycsb_do_test(abstract_db *db, int argc, char **argv);
 extern void tpcc_do_test(abstract_db *db, int argc, char **argv);
@@ -37,12 +40,25 @@ extern uint64_t runtime;
 extern uint64_t ops_per_worker;
 extern int run_mode;
 extern int enable_parallel_loading;
+extern int enable_bulk_loading;
 extern int pin_cpus;
 extern int slow_exit;
 extern int retry_aborted_transaction;
 extern int no_reset_counters;
 extern int backoff_aborted_transaction;
 extern int use_hashtable;
+extern int hashtable_scans;
+extern int use_leaf_cache;
+extern uint64_t compaction_interval_ms;
+extern unsigned cold_compression_idle_ticks;
+extern unsigned eviction_idle_ticks;
+extern int numa_placement;
+extern double open_loop_rate; // aggregate txns/sec, 0 for closed loop
+extern int poisson_arrivals;
+extern uint64_t sample_interval_ms; // 0 to disable the sampler
+extern std::string sample_file;
+extern std::string commit_trace_file; // see --commit-trace-period
+extern int hw_counters_enabled;
 
 class scoped_db_thread_ctx {
 public:
@@ -160,6 +176,17 @@ public:
 
   std::map<std::string, size_t> get_txn_counts() const;
 
+  // per workload_desc entry: latency of the attempt which committed, and
+  // end to end including aborted attempts and backoff (us)
+  typedef std::map<std::string, log_linear_histogram> latency_hist_map;
+  latency_hist_map get_commit_latency_hists() const;
+  latency_hist_map get_e2e_latency_hists() const;
+
+  // per workload_desc entry: hw counter totals over every attempt,
+  // aborted ones included. empty unless hw_counters_enabled
+  typedef std::map<std::string, hw_counters::values> hw_counter_map;
+  hw_counter_map get_hw_counter_totals() const;
+
   typedef abstract_db::counter_map counter_map;
   typedef abstract_db::txn_counter_map txn_counter_map;
 
@@ -203,6 +230,9 @@ protected:
 #endif
 
   std::vector<size_t> txn_counts; // breakdown of txns
+  std::vector<log_linear_histogram> commit_latency_hists;
+  std::vector<log_linear_histogram> e2e_latency_hists;
+  std::vector<hw_counters::values> hw_counter_totals;
   ssize_t size_delta; // how many logical bytes (of values) did the worker add to the DB
 
   std::string txn_obj_buf;
@@ -216,10 +246,25 @@ public:
   bench_runner &operator=(const bench_runner &) = delete;
 
   bench_runner(abstract_db *db)
-    : db(db), barrier_a(nthreads), barrier_b(1) {}
+    : db(db), barrier_a(nthreads), barrier_b(1),
+      compactor_running(false), sampler_running(false) {}
   virtual ~bench_runner() {}
   void run();
 protected:
+  // background loop which periodically compacts all open tables, see
+  // --compaction-interval-ms
+  void compaction_loop();
+
+  // moves records onto their partition's home numa node (see
+  // --numa-placement), returning the number moved. called from
+  // compaction_loop()
+  virtual size_t migrate_tables() { return 0; }
+
+  // background loop which, every --sample-interval-ms, records commits,
+  // aborts (by reason), persisted txns and allocator usage since the last
+  // sample- to --sample-file, and to the stats server
+  void sampler_loop(const std::vector<bench_worker *> &workers);
+
   // only called once
   virtual std::vector<bench_loader*> make_loaders() = 0;
 
@@ -232,6 +277,9 @@ protected:
   // barriers for actual benchmark execution
   spin_barrier barrier_a;
   spin_barrier barrier_b;
+
+  volatile bool compactor_running;
+  volatile bool sampler_running;
 };
 
 // XXX(stephentu): limit_callback is not optimal, should use
@@ -13,6 +13,9 @@
 
 #include "../allocator.h"
 #include "../stats_server.h"
+#include "../evict_store.h"
+#include "../commit_trace.h"
+#include "../conflict_sampler.h"
 #include "bench.h"
 #include "ndb_wrapper.h"
 #include "ndb_wrapper_impl.h"
@@ -73,12 +76,16 @@ main(int argc, char **argv)
   vector<string> logfiles;
   vector<vector<unsigned>> assignments;
   string stats_server_sockfile;
+  string evict_file;
+  string heap_dir;
   while (1) {
     static struct option long_options[] =
     {
       {"verbose"                    , no_argument       , &verbose                   , 1}   ,
       {"parallel-loading"           , no_argument       , &enable_parallel_loading   , 1}   ,
+      {"bulk-loading"               , no_argument       , &enable_bulk_loading       , 1}   ,
       {"pin-cpus"                   , no_argument       , &pin_cpus                  , 1}   ,
+      {"numa-placement"             , no_argument       , &numa_placement            , 1}   ,
       {"slow-exit"                  , no_argument       , &slow_exit                 , 1}   ,
       {"retry-aborted-transactions" , no_argument       , &retry_aborted_transaction , 1}   ,
       {"backoff-aborted-transactions" , no_argument     , &backoff_aborted_transaction , 1}   ,
@@ -102,10 +109,25 @@ main(int argc, char **argv)
       {"stats-server-sockfile"      , required_argument , 0                          , 'x'} ,
       {"no-reset-counters"          , no_argument       , &no_reset_counters         , 1}   ,
       {"use-hashtable"		    , no_argument	, &use_hashtable	     , 1}   ,
+      {"hashtable-scans"            , no_argument       , &hashtable_scans           , 1}   , // ordered index alongside each hashtable
+      {"leaf-cache"                 , no_argument       , &use_leaf_cache            , 1}   , // ndb only
+      {"compaction-interval-ms"     , required_argument , 0                          , 'c'} ,
+      {"cold-compression-idle-ticks", required_argument , 0                          , 'i'} ,
+      {"evict-idle-ticks"           , required_argument , 0                          , 'e'} ,
+      {"evict-file"                 , required_argument , 0                          , 'E'} ,
+      {"heap-dir"                   , required_argument , 0                          , 'H'} , // needs --numa-memory
+      {"open-loop-rate"             , required_argument , 0                          , 'R'} , // aggregate txns/sec
+      {"poisson-arrivals"           , no_argument       , &poisson_arrivals          , 1}   , // needs --open-loop-rate
+      {"sample-interval-ms"         , required_argument , 0                          , 'S'} ,
+      {"sample-file"                , required_argument , 0                          , 'F'} , // needs --sample-interval-ms
+      {"commit-trace-period"        , required_argument , 0                          , 'T'} , // trace 1 in N commits
+      {"commit-trace-file"          , required_argument , 0                          , 'C'} ,
+      {"hw-counters"                , no_argument       , &hw_counters_enabled       , 1}   , // per txn type, via perf_event_open
+      {"conflict-sampling"          , no_argument       , 0                          , 'K'} , // top conflicting keys per table
       {0, 0, 0, 0}
     };
     int option_index = 0;
-    int c = getopt_long(argc, argv, "b:s:t:d:B:f:r:n:o:m:l:a:x:", long_options, &option_index);
+    int c = getopt_long(argc, argv, "b:s:t:d:B:f:r:n:o:m:l:a:x:c:i:e:E:H:R:S:F:T:C:K", long_options, &option_index);
     if (c == -1)
       break;
 
@@ -183,6 +205,53 @@ main(int argc, char **argv)
       stats_server_sockfile = optarg;
       break;
 
+    case 'c':
+      compaction_interval_ms = strtoul(optarg, NULL, 10);
+      break;
+
+    case 'i':
+      cold_compression_idle_ticks = strtoul(optarg, NULL, 10);
+      ALWAYS_ASSERT(cold_compression_idle_ticks <= 255);
+      break;
+
+    case 'e':
+      eviction_idle_ticks = strtoul(optarg, NULL, 10);
+      ALWAYS_ASSERT(eviction_idle_ticks <= 255);
+      break;
+
+    case 'E':
+      evict_file = optarg;
+      break;
+
+    case 'H':
+      heap_dir = optarg;
+      break;
+
+    case 'R':
+      open_loop_rate = strtod(optarg, NULL);
+      ALWAYS_ASSERT(open_loop_rate > 0.0);
+      break;
+
+    case 'S':
+      sample_interval_ms = strtoul(optarg, NULL, 10);
+      break;
+
+    case 'F':
+      sample_file = optarg;
+      break;
+
+    case 'T':
+      commit_trace::g_sample_period = strtoul(optarg, NULL, 10);
+      break;
+
+    case 'C':
+      commit_trace_file = optarg;
+      break;
+
+    case 'K':
+      conflict_sampler::g_enabled = true;
+      break;
+
     case '?':
       /* getopt_long already printed an error message. */
       exit(1);
@@ -222,10 +291,48 @@ main(int argc, char **argv)
     return 1;
   }
 
+  if (enable_bulk_loading && !logfiles.empty()) {
+    // bulk loaded records never go through a txn, so the log misses them
+    cerr << "[ERROR] --bulk-loading cannot be combined with logging" << endl;
+    return 1;
+  }
+
   if (fake_writes && nofsync) {
     cerr << "[WARNING] --log-nofsync has no effect with --log-fake-writes enabled" << endl;
   }
 
+  if (eviction_idle_ticks && evict_file.empty()) {
+    cerr << "[ERROR] --evict-idle-ticks needs an --evict-file" << endl;
+    exit(1);
+  }
+  if (!heap_dir.empty() && !numa_memory) {
+    cerr << "[ERROR] --heap-dir needs --numa-memory" << endl;
+    exit(1);
+  }
+  if (!heap_dir.empty() && db_type != "ndb-proto2") {
+    cerr << "[ERROR] --heap-dir is only supported by ndb-proto2" << endl;
+    exit(1);
+  }
+  if (!heap_dir.empty() && !evict_file.empty()) {
+    // XXX: the evict file is truncated on open, so stubs would dangle
+    cerr << "[ERROR] --heap-dir cannot be combined with --evict-file" << endl;
+    exit(1);
+  }
+  if (poisson_arrivals && open_loop_rate == 0.0) {
+    cerr << "[WARNING] --poisson-arrivals without --open-loop-rate does nothing" << endl;
+  }
+  if (!sample_file.empty() && !sample_interval_ms) {
+    cerr << "[WARNING] --sample-file without --sample-interval-ms does nothing" << endl;
+  }
+  if (numa_placement && !numa_memory) {
+    cerr << "[WARNING] --numa-placement without --numa-memory does nothing" << endl;
+  }
+#ifndef TUPLE_ANTI_CACHING
+  if (eviction_idle_ticks) {
+    cerr << "[WARNING] --evict-idle-ticks without TUPLE_ANTI_CACHING does nothing" << endl;
+  }
+#endif
+
 #ifndef ENABLE_EVENT_COUNTERS
   if (!stats_server_sockfile.empty()) {
     cerr << "[WARNING] --stats-server-sockfile with no event counters enabled is useless" << endl;
@@ -237,7 +344,14 @@ main(int argc, char **argv)
     const size_t maxpercpu = util::iceil(
         numa_memory / nthreads, ::allocator::GetHugepageSize());
     numa_memory = maxpercpu * nthreads;
-    ::allocator::Initialize(nthreads, maxpercpu);
+    ::allocator::Initialize(nthreads, maxpercpu, heap_dir);
+  }
+
+  if (::allocator::IsWarmRestart()) {
+    // commit tids embed the tick, so new ones must order after the heap's
+    uint64_t tick;
+    ALWAYS_ASSERT(::allocator::GetRoot("ticker", tick));
+    ticker::s_instance.fast_forward(tick + 1);
   }
 
   const set<string> can_persist({"ndb-proto2"});
@@ -323,10 +437,16 @@ main(int argc, char **argv)
     cerr << "  pid: " << getpid()                           << endl;
     cerr << "settings:"                                     << endl;
     cerr << "  par-loading : " << enable_parallel_loading   << endl;
+    cerr << "  bulk-loading: " << enable_bulk_loading       << endl;
+    cerr << "  hashtable-scans: " << hashtable_scans        << endl;
+    cerr << "  leaf-cache  : " << use_leaf_cache            << endl;
     cerr << "  pin-cpus    : " << pin_cpus                  << endl;
+    cerr << "  numa-placement : " << numa_placement         << endl;
     cerr << "  slow-exit   : " << slow_exit                 << endl;
     cerr << "  retry-txns  : " << retry_aborted_transaction << endl;
     cerr << "  backoff-txns: " << backoff_aborted_transaction << endl;
+    cerr << "  open-loop-rate: " << open_loop_rate         << endl;
+    cerr << "  poisson-arrivals: " << poisson_arrivals     << endl;
     cerr << "  bench       : " << bench_type                << endl;
     cerr << "  scale       : " << scale_factor              << endl;
     cerr << "  num-cpus    : " << ncpus                     << endl;
@@ -363,6 +483,17 @@ main(int argc, char **argv)
     cerr << "  disable-gc : " << disable_gc                 << endl;
     cerr << "  disable-snapshots : " << disable_snapshots   << endl;
     cerr << "  stats-server-sockfile: " << stats_server_sockfile << endl;
+    cerr << "  compaction-interval-ms: " << compaction_interval_ms << endl;
+    cerr << "  cold-compression-idle-ticks: " << cold_compression_idle_ticks << endl;
+    cerr << "  evict-idle-ticks: " << eviction_idle_ticks << endl;
+    cerr << "  evict-file: " << evict_file << endl;
+    cerr << "  heap-dir: " << heap_dir << endl;
+    cerr << "  sample-interval-ms: " << sample_interval_ms << endl;
+    cerr << "  sample-file: " << sample_file << endl;
+    cerr << "  commit-trace-period: " << commit_trace::g_sample_period << endl;
+    cerr << "  commit-trace-file: " << commit_trace_file << endl;
+    cerr << "  hw-counters: " << hw_counters_enabled << endl;
+    cerr << "  conflict-sampling: " << conflict_sampler::g_enabled << endl;
 
     cerr << "system properties:" << endl;
     cerr << "  btree_internal_node_size: " << concurrent_btree::InternalNodeSize() << endl;
@@ -387,6 +518,12 @@ main(int argc, char **argv)
     thread(&stats_server::serve_forever, srvr).detach();
   }
 
+  if (!evict_file.empty())
+    evict_store::s_instance.open(evict_file);
+
+  // new versions of a record stay on its home node
+  rcu::g_sticky_placement = numa_placement;
+
   vector<string> bench_toks = split_ws(bench_opts);
   int argc = 1 + bench_toks.size();
   char *argv[argc];
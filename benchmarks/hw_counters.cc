@@ -0,0 +1,106 @@
+#include <iostream>
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "hw_counters.h"
+
+using namespace std;
+
+static int
+open_event(uint32_t type, uint64_t config, int group_fd)
+{
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.read_format = PERF_FORMAT_GROUP;
+  attr.disabled = group_fd == -1; // the leader starts the whole group
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  // pid=0, cpu=-1: this thread, on whatever cpu it runs
+  return syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+static inline uint64_t
+cache_event(uint64_t cache, uint64_t op, uint64_t result)
+{
+  return cache | (op << 8) | (result << 16);
+}
+
+hw_counters::hw_counters()
+  : nopen_(0)
+{
+  for (size_t i = 0; i < NEVENTS; i++)
+    fds_[i] = pos_[i] = -1;
+
+  fds_[EV_CYCLES] =
+    open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+  if (fds_[EV_CYCLES] == -1) {
+    static bool s_warned = false;
+    if (!s_warned) {
+      // racy, but only a warning
+      s_warned = true;
+      perror("perf_event_open- hw counters disabled");
+    }
+    return;
+  }
+  pos_[EV_CYCLES] = nopen_++;
+
+  const int leader = fds_[EV_CYCLES];
+  fds_[EV_INSTRUCTIONS] =
+    open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, leader);
+  fds_[EV_LLC_MISSES] =
+    open_event(PERF_TYPE_HW_CACHE,
+               cache_event(PERF_COUNT_HW_CACHE_LL,
+                           PERF_COUNT_HW_CACHE_OP_READ,
+                           PERF_COUNT_HW_CACHE_RESULT_MISS),
+               leader);
+  fds_[EV_DTLB_MISSES] =
+    open_event(PERF_TYPE_HW_CACHE,
+               cache_event(PERF_COUNT_HW_CACHE_DTLB,
+                           PERF_COUNT_HW_CACHE_OP_READ,
+                           PERF_COUNT_HW_CACHE_RESULT_MISS),
+               leader);
+  fds_[EV_BRANCH_MISSES] =
+    open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, leader);
+  for (size_t i = EV_CYCLES + 1; i < NEVENTS; i++)
+    if (fds_[i] != -1)
+      pos_[i] = nopen_++;
+
+  if (ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP) ||
+      ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP)) {
+    perror("ioctl");
+    ALWAYS_ASSERT(false);
+  }
+}
+
+hw_counters::~hw_counters()
+{
+  for (size_t i = 0; i < NEVENTS; i++)
+    if (fds_[i] != -1)
+      close(fds_[i]);
+}
+
+void
+hw_counters::read(values &v) const
+{
+  if (!ok()) {
+    v = values();
+    return;
+  }
+  // { nr, values[nr] }
+  uint64_t buf[1 + NEVENTS];
+  const ssize_t want = (1 + nopen_) * sizeof(uint64_t);
+  if (::read(fds_[EV_CYCLES], &buf[0], sizeof(buf)) != want) {
+    perror("read");
+    ALWAYS_ASSERT(false);
+  }
+  INVARIANT(buf[0] == nopen_);
+  for (size_t i = 0; i < NEVENTS; i++)
+    v.v_[i] = pos_[i] == -1 ? 0 : buf[1 + pos_[i]];
+}
@@ -0,0 +1,92 @@
+#ifndef _NDB_BENCH_HW_COUNTERS_H_
+#define _NDB_BENCH_HW_COUNTERS_H_
+
+#include <stdint.h>
+
+#include "../macros.h"
+
+/**
+ * Hardware performance counters for the calling thread, via
+ * perf_event_open(2), opened as one group so they are read together and
+ * scheduled onto the PMU together. Only user mode is counted, which works
+ * under the default perf_event_paranoid.
+ *
+ * Events the CPU (or the hypervisor) does not support just stay at zero-
+ * see supported(). If the group leader (cycles) cannot be opened at all,
+ * ok() is false and every read is zero
+ */
+class hw_counters {
+public:
+
+  enum event {
+    EV_CYCLES = 0,
+    EV_INSTRUCTIONS,
+    EV_LLC_MISSES,
+    EV_DTLB_MISSES,
+    EV_BRANCH_MISSES,
+    NEVENTS,
+  };
+
+  static const char *
+  EventStr(event e)
+  {
+    switch (e) {
+    case EV_CYCLES:        return "cycles";
+    case EV_INSTRUCTIONS:  return "instructions";
+    case EV_LLC_MISSES:    return "llc_misses";
+    case EV_DTLB_MISSES:   return "dtlb_misses";
+    case EV_BRANCH_MISSES: return "branch_misses";
+    default:
+      break;
+    }
+    ALWAYS_ASSERT(false);
+    return 0;
+  }
+
+  struct values {
+    values()
+    {
+      NDB_MEMSET(&v_[0], 0, sizeof(v_));
+    }
+
+    inline values &
+    operator+=(const values &that)
+    {
+      for (size_t i = 0; i < NEVENTS; i++)
+        v_[i] += that.v_[i];
+      return *this;
+    }
+
+    inline values
+    operator-(const values &that) const
+    {
+      values ret;
+      for (size_t i = 0; i < NEVENTS; i++)
+        ret.v_[i] = v_[i] - that.v_[i];
+      return ret;
+    }
+
+    uint64_t v_[NEVENTS];
+  };
+
+  // opens (and starts) the counters for the calling thread
+  hw_counters();
+  ~hw_counters();
+
+  hw_counters(const hw_counters &) = delete;
+  hw_counters(hw_counters &&) = delete;
+  hw_counters &operator=(const hw_counters &) = delete;
+
+  inline bool ok() const { return fds_[EV_CYCLES] != -1; }
+  inline bool supported(event e) const { return fds_[e] != -1; }
+
+  // totals since the counters were opened. one read(2) for the group
+  void read(values &v) const;
+
+private:
+  int fds_[NEVENTS];
+  int pos_[NEVENTS]; // position in the group read
+  unsigned nopen_;
+};
+
+#endif /* _NDB_BENCH_HW_COUNTERS_H_ */
@@ -83,6 +83,7 @@ public:
       void *txn,
       lcdf::Str key);
   virtual size_t size() const;
+  virtual size_t exact_size() const;
   virtual std::map<std::string, uint64_t> clear();
 private:
   std::string name;
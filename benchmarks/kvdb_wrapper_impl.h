@@ -450,6 +450,13 @@ kvdb_ordered_index<UseConcurrencyControl>::remove(void *txn, lcdf::Str key)
 template <bool UseConcurrencyControl>
 size_t
 kvdb_ordered_index<UseConcurrencyControl>::size() const
+{
+  return btr.size_estimate();
+}
+
+template <bool UseConcurrencyControl>
+size_t
+kvdb_ordered_index<UseConcurrencyControl>::exact_size() const
 {
   return btr.size();
 }
@@ -11,6 +11,7 @@
 #include "sto/simple_str.hh"
 #include "sto/StringWrapper.hh"
 #include <unordered_map> 
+#include <memory>
 //#include "tpcc.h"
 
 #define STD_OP(f) \
@@ -139,355 +140,116 @@ mbta_wrapper *db;
 
 };
 
-class ht_ordered_index_string : public abstract_ordered_index {
-public:
-ht_ordered_index_string(const std::string &name, mbta_wrapper *db) : ht(), name(name), db(db) {}
-
-std::string *arena(void);
-
-bool get(void *txn, lcdf::Str key, std::string &value, size_t max_bytes_read) {
-#if OP_LOGGING
-ht_get++;
-#endif
-STD_OP({
-// TODO: we'll still be faster if we just add support for max_bytes_read
-bool ret = ht.transGet(key, value);
-// TODO: can we support this directly (max_bytes_read)? would avoid this wasted allocation
-return ret;
-  });
-}
-
-const char *put(
-void* txn,
-const lcdf::Str key,
-const std::string &value)
-{
-#if OP_LOGGING
-ht_put++;
-#endif
-// TODO: there's an overload of put that takes non-const std::string and silo seems to use move for those.
-// may be worth investigating if we can use that optimization to avoid copying keys
-STD_OP({
-ht.transPut(key, StringWrapper(value));
-        return 0;
-          });
-  }
-
-  const char *insert(void *txn,
-                     lcdf::Str key,
-                     const std::string &value)
-  {
-#if OP_LOGGING
-    ht_insert++;
-#endif
-    STD_OP({
-	ht.transPut(key, StringWrapper(value)); return 0;
-	});
-  }
-
-  void remove(void *txn, lcdf::Str key) {
-#if OP_LOGGING
-    ht_del++;
-#endif    
-    STD_OP({
-	ht.transDelete(key);
-    });
-  }
-
-  void scan(void *txn,
-            const std::string &start_key,
-            const std::string *end_key,
-            scan_callback &callback,
-            str_arena *arena = nullptr) {
-    NDB_UNIMPLEMENTED("scan");
-  }
-
-  void rscan(void *txn,
-             const std::string &start_key,
-             const std::string *end_key,
-             scan_callback &callback,
-             str_arena *arena = nullptr) {
-    NDB_UNIMPLEMENTED("rscan");
-  }
-
-  size_t size() const
-  {
-    return 0;
-  }
-
-  // TODO: unclear if we need to implement, apparently this should clear the tree and possibly return some stats
-  std::map<std::string, uint64_t>
-  clear() {
-    throw 2;
-  }
-
-  typedef Hashtable<std::string, std::string, false/*opacity*/, 999983, simple_str> ht_type;
-private:
-  friend class mbta_wrapper;
-  ht_type ht;
-
-  const std::string name;
-
-  mbta_wrapper *db;
-
-};
-
-
-class ht_ordered_index_int : public abstract_ordered_index {
-public:
-  ht_ordered_index_int(const std::string &name, mbta_wrapper *db) : ht(), name(name), db(db) {}
-
-  std::string *arena(void);
-
-  bool get(void *txn, lcdf::Str key, std::string &value, size_t max_bytes_read) {
-    return false;
-  }
-
-  bool get(
-      void *txn,
-      int32_t key,
-      std::string &value,
-      size_t max_bytes_read = std::string::npos) {
-#if OP_LOGGING
-    ht_get++;
-#endif
-    STD_OP({
-        bool ret = ht.transGet(key, value);
-        return ret;
-          });
-
-  }
-
-
-  const char *put(
-      void* txn,
-      lcdf::Str key,
-      const std::string &value)
-  {
-    return 0;
-  }
-
-  const char *put(
-      void* txn,
-      int32_t key,
-      const std::string &value)
+// recovers a hashtable key from the bytes handed to abstract_ordered_index.
+// fixed size keys (tpcc_keys.h) are passed around as their raw bytes- 32-bit
+// fields in host order, which do not sort like the keys do. The ordered
+// index gets them as big-endian words instead, w/ the sign bit of int32_t
+// fields flipped, so that memcmp() orders them field by field.
+// unsigned_words() has bit i set if the i-th field is a uint32_t
+template <typename K>
+struct ht_key_codec {
+  static inline K
+  decode(lcdf::Str key)
   {
-#if OP_LOGGING
-    ht_put++;
-#endif
-    STD_OP({
-        ht.transPut(key, StringWrapper(value));
-        return 0;
-          });
+    assert(key.length() == sizeof(K));
+    K k;
+    memcpy(&k, key.data(), sizeof(K));
+    return k;
   }
 
-  
-  const char *insert(void *txn,
-                     lcdf::Str key,
-                     const std::string &value)
+  static inline uint32_t
+  unsigned_words()
   {
     return 0;
   }
 
-  const char *insert(void *txn,
-                     int32_t key,
-                     const std::string &value)
+  static inline std::string
+  encode_ordered(lcdf::Str key)
   {
-#if OP_LOGGING
-    ht_insert++;
-#endif
-    STD_OP({
-        ht.transPut(key, StringWrapper(value)); return 0;});
-  }
-
-
-  void remove(void *txn, lcdf::Str key) {
-      return;
-  }
-
-  void remove(void *txn, int32_t key) {
-#if OP_LOGGING
-    ht_del++;
-#endif    
-    STD_OP({
-        ht.transDelete(key);});
-  }     
-
-  void scan(void *txn,
-            const std::string &start_key,
-            const std::string *end_key,
-            scan_callback &callback,
-            str_arena *arena = nullptr) {
-    NDB_UNIMPLEMENTED("scan");
-  }
-
-  void rscan(void *txn,
-             const std::string &start_key,
-             const std::string *end_key,
-             scan_callback &callback,
-             str_arena *arena = nullptr) {
-    NDB_UNIMPLEMENTED("rscan");
+    static_assert(sizeof(K) % sizeof(uint32_t) == 0, "K not all 32-bit fields");
+    // an empty (scan from the start) key stays empty
+    if (!key.length())
+      return std::string();
+    assert(key.length() == sizeof(K));
+    std::string ret(sizeof(K), '\0');
+    for (size_t i = 0; i < sizeof(K) / sizeof(uint32_t); i++) {
+      uint32_t w;
+      memcpy(&w, key.data() + i * sizeof(w), sizeof(w));
+      if (!(unsigned_words() & (1U << i)))
+        w ^= 0x80000000U;
+      w = util::big_endian_trfm<uint32_t>()(w);
+      memcpy(&ret[i * sizeof(w)], &w, sizeof(w));
+    }
+    return ret;
   }
 
-  size_t size() const
+  // the inverse of encode_ordered()
+  static inline std::string
+  decode_ordered(lcdf::Str key)
   {
-    return 0;
-  }
-
-  // TODO: unclear if we need to implement, apparently this should clear the tree and possibly return some stats
-  std::map<std::string, uint64_t>
-  clear() {
-    throw 2;
-  }
-
-  void print_stats() {
-    printf("Hashtable %s: ", name.data());
-    ht.print_stats();
+    assert(key.length() == sizeof(K));
+    std::string ret(sizeof(K), '\0');
+    for (size_t i = 0; i < sizeof(K) / sizeof(uint32_t); i++) {
+      uint32_t w;
+      memcpy(&w, key.data() + i * sizeof(w), sizeof(w));
+      w = util::host_endian_trfm<uint32_t>()(w);
+      if (!(unsigned_words() & (1U << i)))
+        w ^= 0x80000000U;
+      memcpy(&ret[i * sizeof(w)], &w, sizeof(w));
+    }
+    return ret;
   }
-
-  typedef Hashtable<int32_t, std::string, false/*opacity*/, 227497, simple_str> ht_type;
-  //typedef std::unordered_map<K, std::string> ht_type;
-private:
-  friend class mbta_wrapper;
-  ht_type ht;
-
-  const std::string name;
-
-  mbta_wrapper *db;
-
 };
 
+// h_date
+template <>
+inline uint32_t
+ht_key_codec<history_key>::unsigned_words()
+{
+  return 1U << 5;
+}
 
-class ht_ordered_index_customer_key : public abstract_ordered_index {
-public:
-  ht_ordered_index_customer_key(const std::string &name, mbta_wrapper *db) : ht(), name(name), db(db) {}
-
-  std::string *arena(void);
-
-  bool get(void *txn, lcdf::Str key, std::string &value, size_t max_bytes_read) {
-    return false;
-  }
-
-  bool get(
-      void *txn,
-      customer_key key,
-      std::string &value,
-      size_t max_bytes_read = std::string::npos) {
-#if OP_LOGGING
-    ht_get++;
-#endif
-    STD_OP({
-        bool ret = ht.transGet(key, value);
-        return ret;
-          });
-
-  }
-
-
-  const char *put(
-      void* txn,
-      lcdf::Str key,
-      const std::string &value)
+template <>
+struct ht_key_codec<std::string> {
+  static inline std::string
+  decode(lcdf::Str key)
   {
-    return 0;
+    return std::string(key.data(), key.length());
   }
 
-  const char *put(
-      void* txn,
-      customer_key key,
-      const std::string &value)
+  static inline std::string
+  encode_ordered(lcdf::Str key)
   {
-#if OP_LOGGING
-    ht_put++;
-#endif
-    STD_OP({
-        ht.transPut(key, StringWrapper(value));
-        return 0;
-          });
+    return std::string(key.data(), key.length());
   }
 
-  
-  const char *insert(void *txn,
-                     lcdf::Str key,
-                     const std::string &value)
+  static inline std::string
+  decode_ordered(lcdf::Str key)
   {
-    return 0;
+    return std::string(key.data(), key.length());
   }
-
-  const char *insert(void *txn,
-                     customer_key key,
-                     const std::string &value)
-  {
-#if OP_LOGGING
-    ht_insert++;
-#endif
-    STD_OP({
-        ht.transPut(key, StringWrapper(value)); return 0;});
-  }
-
-
-  void remove(void *txn, lcdf::Str key) {
-      return;
-  }
-
-  void remove(void *txn, customer_key key) {
-#if OP_LOGGING
-    ht_del++;
-#endif    
-    STD_OP({
-        ht.transDelete(key);});
-  }     
-
-  void scan(void *txn,
-            const std::string &start_key,
-            const std::string *end_key,
-            scan_callback &callback,
-            str_arena *arena = nullptr) {
-    NDB_UNIMPLEMENTED("scan");
-  }
-
-  void rscan(void *txn,
-             const std::string &start_key,
-             const std::string *end_key,
-             scan_callback &callback,
-             str_arena *arena = nullptr) {
-    NDB_UNIMPLEMENTED("rscan");
-  }
-
-  size_t size() const
-  {
-    return 0;
-  }
-
-  // TODO: unclear if we need to implement, apparently this should clear the tree and possibly return some stats
-  std::map<std::string, uint64_t>
-  clear() {
-    throw 2;
-  }
-  
-   void print_stats() {
-    printf("Hashtable %s: ", name.data());
-    ht.print_stats();
-  }
-
-  typedef Hashtable<customer_key, std::string, false/*opacity*/, 999983, simple_str> ht_type;
-  //typedef std::unordered_map<K, std::string> ht_type;
-private:
-  friend class mbta_wrapper;
-  ht_type ht;
-
-  const std::string name;
-
-  mbta_wrapper *db;
-
 };
 
-
-class ht_ordered_index_history_key : public abstract_ordered_index {
+/**
+ * Transactional hash index over keys of type K (see ht_key_codec), for
+ * tables which are mostly point accessed.
+ *
+ * If scannable, every key is also kept in an ordered (masstree) index in
+ * the same txn (as ht_key_codec<K>::encode_ordered()), which serves
+ * scan()/rscan() by looking each key it yields up in the hashtable.
+ * Otherwise those are unimplemented
+ *
+ * XXX: the hashtable's bucket count is fixed when it is created, so
+ * Init_size has to be picked for the largest scale the table is run at
+ */
+template <typename K, unsigned Init_size>
+class ht_ordered_index : public abstract_ordered_index {
 public:
-  ht_ordered_index_history_key(const std::string &name, mbta_wrapper *db) : ht(), name(name), db(db) {}
+  typedef Hashtable<K, std::string, false/*opacity*/, Init_size, simple_str> ht_type;
+  typedef mbta_ordered_index::mbta_type ordered_type;
 
-  std::string *arena(void);
+  ht_ordered_index(const std::string &name, mbta_wrapper *db, bool scannable)
+    : ht(), ordered(scannable ? new ordered_type : nullptr), name(name), db(db) {}
 
   bool get(
       void *txn,
@@ -498,14 +260,11 @@ public:
     ht_get++;
 #endif
     STD_OP({
-        assert(key.length() == sizeof(history_key));
-        const history_key& k = *(reinterpret_cast<const history_key*>(key.data())); 
-        bool ret = ht.transGet(k, value);
+        bool ret = ht.transGet(ht_key_codec<K>::decode(key), value);
         return ret;
           });
-
   }
-  
+
   const char *put(
       void* txn,
       lcdf::Str key,
@@ -515,9 +274,12 @@ public:
     ht_put++;
 #endif
     STD_OP({
-        assert(key.length() == sizeof(history_key));
-        const history_key& k = *(reinterpret_cast<const history_key*>(key.data()));
-        ht.transPut(k, StringWrapper(value));
+        ht.transPut(ht_key_codec<K>::decode(key), StringWrapper(value));
+        // a blind write- reading first would add a read set entry (and so
+        // aborts) to every put
+        if (ordered)
+          ordered->transPut(ht_key_codec<K>::encode_ordered(key),
+                            StringWrapper(std::string()));
         return 0;
           });
   }
@@ -530,133 +292,42 @@ public:
     ht_insert++;
 #endif
     STD_OP({
-        assert(key.length() == sizeof(history_key));
-        const history_key& k = *(reinterpret_cast<const history_key*>(key.data()));
-        ht.transPut(k, StringWrapper(value)); return 0;});
+        ht.transPut(ht_key_codec<K>::decode(key), StringWrapper(value));
+        if (ordered)
+          ordered->transInsert(ht_key_codec<K>::encode_ordered(key),
+                               StringWrapper(std::string()));
+        return 0;
+          });
   }
 
   void remove(void *txn, lcdf::Str key) {
 #if OP_LOGGING
     ht_del++;
-#endif    
-    STD_OP({
-        assert(key.length() == sizeof(history_key));
-        const history_key& k = *(reinterpret_cast<const history_key*>(key.data()));
-        ht.transDelete(k);});
-  }     
-
-  void scan(void *txn,
-            const std::string &start_key,
-            const std::string *end_key,
-            scan_callback &callback,
-            str_arena *arena = nullptr) {
-    NDB_UNIMPLEMENTED("scan");
-  }
-
-  void rscan(void *txn,
-             const std::string &start_key,
-             const std::string *end_key,
-             scan_callback &callback,
-             str_arena *arena = nullptr) {
-    NDB_UNIMPLEMENTED("rscan");
-  }
-
-  size_t size() const
-  {
-    return 0;
-  }
-
-  // TODO: unclear if we need to implement, apparently this should clear the tree and possibly return some stats
-  std::map<std::string, uint64_t>
-  clear() {
-    throw 2;
-  }
-
-   void print_stats() {
-    printf("Hashtable %s: ", name.data());
-    ht.print_stats();
-  }
-
-  typedef Hashtable<history_key, std::string, false/*opacity*/, 20000003, simple_str> ht_type;
-private:
-  friend class mbta_wrapper;
-  ht_type ht;
-
-  const std::string name;
-
-  mbta_wrapper *db;
-
-};
-
-
-class ht_ordered_index_oorder_key : public abstract_ordered_index {
-public:
-  ht_ordered_index_oorder_key(const std::string &name, mbta_wrapper *db) : ht(), name(name), db(db) {}
-
-  std::string *arena(void);
-
-  bool get(
-      void *txn,
-      lcdf::Str key,
-      std::string &value,
-      size_t max_bytes_read = std::string::npos) {
-#if OP_LOGGING
-    ht_get++;
-#endif
-    STD_OP({
-        assert(key.length() == sizeof(oorder_key));
-        const oorder_key& k = *(reinterpret_cast<const oorder_key*>(key.data())); 
-        bool ret = ht.transGet(k, value);
-        return ret;
-          });
-
-  }
-  
-  const char *put(
-      void* txn,
-      lcdf::Str key,
-      const std::string &value)
-  {
-#if OP_LOGGING
-    ht_put++;
 #endif
     STD_OP({
-        assert(key.length() == sizeof(oorder_key));
-        const oorder_key& k = *(reinterpret_cast<const oorder_key*>(key.data()));
-        ht.transPut(k, StringWrapper(value));
-        return 0;
+        ht.transDelete(ht_key_codec<K>::decode(key));
+        if (ordered)
+          ordered->transDelete(ht_key_codec<K>::encode_ordered(key));
           });
   }
 
-  const char *insert(void *txn,
-                     lcdf::Str key,
-                     const std::string &value)
-  {
-#if OP_LOGGING
-    ht_insert++;
-#endif
-    STD_OP({
-        assert(key.length() == sizeof(oorder_key));
-        const oorder_key& k = *(reinterpret_cast<const oorder_key*>(key.data()));
-        ht.transPut(k, StringWrapper(value)); return 0;});
-  }
-
-  void remove(void *txn, lcdf::Str key) {
-#if OP_LOGGING
-    ht_del++;
-#endif    
-    STD_OP({
-        assert(key.length() == sizeof(oorder_key));
-        const oorder_key& k = *(reinterpret_cast<const oorder_key*>(key.data()));
-        ht.transDelete(k);});
-  }     
-
   void scan(void *txn,
             const std::string &start_key,
             const std::string *end_key,
             scan_callback &callback,
             str_arena *arena = nullptr) {
-    NDB_UNIMPLEMENTED("scan");
+    if (!ordered)
+      NDB_UNIMPLEMENTED("scan");
+#if OP_LOGGING
+    mt_scan++;
+#endif
+    const std::string start = ht_key_codec<K>::encode_ordered(start_key);
+    const std::string end_enc =
+      end_key ? ht_key_codec<K>::encode_ordered(*end_key) : std::string();
+    typename ordered_type::Str end = end_key ? typename ordered_type::Str(end_enc) : typename ordered_type::Str();
+    STD_OP(ordered->transQuery(start, end, [&] (typename ordered_type::Str key, std::string&) {
+      return invoke(key, callback);
+    }, arena));
   }
 
   void rscan(void *txn,
@@ -664,12 +335,23 @@ public:
              const std::string *end_key,
              scan_callback &callback,
              str_arena *arena = nullptr) {
-    NDB_UNIMPLEMENTED("rscan");
+    if (!ordered)
+      NDB_UNIMPLEMENTED("rscan");
+#if OP_LOGGING
+    mt_rscan++;
+#endif
+    const std::string start = ht_key_codec<K>::encode_ordered(start_key);
+    const std::string end_enc =
+      end_key ? ht_key_codec<K>::encode_ordered(*end_key) : std::string();
+    typename ordered_type::Str end = end_key ? typename ordered_type::Str(end_enc) : typename ordered_type::Str();
+    STD_OP(ordered->transRQuery(start, end, [&] (typename ordered_type::Str key, std::string&) {
+      return invoke(key, callback);
+    }, arena));
   }
 
   size_t size() const
   {
-    return 0;
+    return ordered ? ordered->approx_size() : 0;
   }
 
   // TODO: unclear if we need to implement, apparently this should clear the tree and possibly return some stats
@@ -678,122 +360,28 @@ public:
     throw 2;
   }
 
-   void print_stats() {
+  void print_stats() {
     printf("Hashtable %s: ", name.data());
     ht.print_stats();
   }
 
-
-  typedef Hashtable<oorder_key, std::string, false/*opacity*/, 20000003, simple_str> ht_type;
 private:
-  friend class mbta_wrapper;
-  ht_type ht;
-
-  const std::string name;
-
-  mbta_wrapper *db;
-
-};
-
-
-class ht_ordered_index_stock_key : public abstract_ordered_index {
-public:
-  ht_ordered_index_stock_key(const std::string &name, mbta_wrapper *db) : ht(), name(name), db(db) {}
-
-  std::string *arena(void);
-
-  bool get(
-      void *txn,
-      lcdf::Str key,
-      std::string &value,
-      size_t max_bytes_read = std::string::npos) {
-#if OP_LOGGING
-    ht_get++;
-#endif
-    STD_OP({
-        assert(key.length() == sizeof(stock_key));
-        const stock_key& k = *(reinterpret_cast<const stock_key*>(key.data())); 
-        bool ret = ht.transGet(k, value);
-        return ret;
-          });
-
-  }
-  
-  const char *put(
-      void* txn,
-      lcdf::Str key,
-      const std::string &value)
-  {
-#if OP_LOGGING
-    ht_put++;
-#endif
-    STD_OP({
-        assert(key.length() == sizeof(stock_key));
-        const stock_key& k = *(reinterpret_cast<const stock_key*>(key.data()));
-        ht.transPut(k, StringWrapper(value));
-        return 0;
-          });
-  }
-
-  const char *insert(void *txn,
-                     lcdf::Str key,
-                     const std::string &value)
+  inline bool
+  invoke(typename ordered_type::Str key, scan_callback &callback)
   {
-#if OP_LOGGING
-    ht_insert++;
-#endif
-    STD_OP({
-        assert(key.length() == sizeof(stock_key));
-        const stock_key& k = *(reinterpret_cast<const stock_key*>(key.data()));
-        ht.transPut(k, StringWrapper(value)); return 0;});
+    std::string value;
+    const std::string k =
+      ht_key_codec<K>::decode_ordered(lcdf::Str(key.data(), key.length()));
+    // both live in the same txn, so the hashtable has every key the
+    // ordered index does
+    bool ret = ht.transGet(ht_key_codec<K>::decode(k), value);
+    assert(ret);
+    return !ret || callback.invoke(k.data(), k.length(), value);
   }
 
-  void remove(void *txn, lcdf::Str key) {
-#if OP_LOGGING
-    ht_del++;
-#endif    
-    STD_OP({
-        assert(key.length() == sizeof(stock_key));
-        const stock_key& k = *(reinterpret_cast<const stock_key*>(key.data()));
-        ht.transDelete(k);});
-  }     
-
-  void scan(void *txn,
-            const std::string &start_key,
-            const std::string *end_key,
-            scan_callback &callback,
-            str_arena *arena = nullptr) {
-    NDB_UNIMPLEMENTED("scan");
-  }
-
-  void rscan(void *txn,
-             const std::string &start_key,
-             const std::string *end_key,
-             scan_callback &callback,
-             str_arena *arena = nullptr) {
-    NDB_UNIMPLEMENTED("rscan");
-  }
-
-  size_t size() const
-  {
-    return 0;
-  }
-
-  // TODO: unclear if we need to implement, apparently this should clear the tree and possibly return some stats
-  std::map<std::string, uint64_t>
-  clear() {
-    throw 2;
-  }
-
-   void print_stats() {
-    printf("Hashtable %s: ", name.data());
-    ht.print_stats();
-  }
-
-  typedef Hashtable<stock_key, std::string, false/*opacity*/, 3000017, simple_str> ht_type;
-private:
   friend class mbta_wrapper;
   ht_type ht;
+  std::unique_ptr<ordered_type> ordered;
 
   const std::string name;
 
@@ -801,7 +389,6 @@ private:
 
 };
 
-
 class mbta_wrapper : public abstract_db {
 public:
   ssize_t txn_max_batch_size() const OVERRIDE { return 100; }
@@ -883,17 +470,20 @@ public:
              size_t value_size_hint,
 	     bool mostly_append = false,
              bool use_hashtable = false) {
+#if HASHTABLE
+    // the hashtables need HASHTABLE's raw key encodings (tpcc.h)
     if (use_hashtable) {
-      if (name.find("customer") == 0) 
-        return new ht_ordered_index_customer_key(name, this);
+      if (name.find("customer") == 0)
+        return new ht_ordered_index<customer_key, 999983>(name, this, hashtable_scans);
       if (name.find("history") == 0)
-	return new ht_ordered_index_history_key(name, this);
+        return new ht_ordered_index<history_key, 20000003>(name, this, hashtable_scans);
       if (name.find("oorder") == 0)
-	return new ht_ordered_index_oorder_key(name, this);
+        return new ht_ordered_index<oorder_key, 20000003>(name, this, hashtable_scans);
       if (name.find("stock") == 0)
-        return new ht_ordered_index_stock_key(name, this);
-      return new ht_ordered_index_int(name, this);
+        return new ht_ordered_index<stock_key, 3000017>(name, this, hashtable_scans);
+      return new ht_ordered_index<int32_t, 227497>(name, this, hashtable_scans);
     }
+#endif
     auto ret = new mbta_ordered_index(name, this);
     return ret;
   }
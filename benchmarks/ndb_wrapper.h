@@ -117,6 +117,21 @@ protected:
 
 public:
   ndb_ordered_index(const std::string &name, size_t value_size_hint, bool mostly_append);
+
+  // for point-access-only tables. not thread safe
+  inline void
+  enable_point_index()
+  {
+    btr.enable_point_index();
+  }
+
+  // for skewed point lookups. not thread safe
+  inline void
+  enable_leaf_cache()
+  {
+    btr.enable_leaf_cache();
+  }
+
   virtual bool get(
       void *txn,
       const std::string &key,
@@ -177,6 +192,15 @@ public:
       void *txn,
       lcdf::Str key);
   virtual size_t size() const;
+  virtual size_t exact_size() const;
+  virtual size_t compact();
+  virtual void set_cold_compression(unsigned min_idle_ticks);
+  virtual void set_eviction(unsigned min_idle_ticks);
+  virtual size_t migrate(ssize_t home_cpu);
+  virtual ssize_t bulk_load(
+      const std::vector<std::pair<std::string, std::string>> &records);
+  virtual bool save_root();
+  virtual bool reattach_root();
   virtual std::map<std::string, uint64_t> clear();
 private:
   std::string name;
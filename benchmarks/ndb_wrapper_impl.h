@@ -5,6 +5,7 @@
 #include "ndb_wrapper.h"
 #include "../counter.h"
 #include "../rcu.h"
+#include "../allocator.h"
 #include "../varkey.h"
 #include "../macros.h"
 #include "../util.h"
@@ -280,7 +281,14 @@ template <template <typename> class Transaction>
 abstract_ordered_index *
 ndb_wrapper<Transaction>::open_index(const std::string &name, size_t value_size_hint, bool mostly_append, bool use_hashtable)
 {
-  return new ndb_ordered_index<Transaction>(name, value_size_hint, mostly_append);
+  ndb_ordered_index<Transaction> *idx =
+    new ndb_ordered_index<Transaction>(name, value_size_hint, mostly_append);
+  if (use_hashtable)
+    idx->enable_point_index();
+  // every append invalidates the cached position of its leaf's keys
+  if (use_leaf_cache && !mostly_append)
+    idx->enable_leaf_cache();
+  return idx;
 }
 
 template <template <typename> class Transaction>
@@ -631,6 +639,73 @@ ndb_ordered_index<Transaction>::size() const
   return btr.size_estimate();
 }
 
+template <template <typename> class Transaction>
+size_t
+ndb_ordered_index<Transaction>::exact_size() const
+{
+  return btr.size_exact();
+}
+
+template <template <typename> class Transaction>
+size_t
+ndb_ordered_index<Transaction>::compact()
+{
+  return btr.purge_tombstones() + btr.compact() +
+         btr.compress_cold() + btr.evict_cold();
+}
+
+template <template <typename> class Transaction>
+void
+ndb_ordered_index<Transaction>::set_cold_compression(unsigned min_idle_ticks)
+{
+  btr.set_cold_compression(std::min(min_idle_ticks, 255u));
+}
+
+template <template <typename> class Transaction>
+void
+ndb_ordered_index<Transaction>::set_eviction(unsigned min_idle_ticks)
+{
+  btr.set_eviction(std::min(min_idle_ticks, 255u));
+}
+
+template <template <typename> class Transaction>
+size_t
+ndb_ordered_index<Transaction>::migrate(ssize_t home_cpu)
+{
+  // the whole index lives in one place
+  const auto home_cpu_fn = [home_cpu](const concurrent_btree::string_type &) {
+    return home_cpu;
+  };
+  return btr.migrate(home_cpu_fn);
+}
+
+template <template <typename> class Transaction>
+ssize_t
+ndb_ordered_index<Transaction>::bulk_load(
+    const std::vector<std::pair<std::string, std::string>> &records)
+{
+  return btr.bulk_load(records.begin(), records.end());
+}
+
+template <template <typename> class Transaction>
+bool
+ndb_ordered_index<Transaction>::save_root()
+{
+  ::allocator::SetRoot("btree:" + name, uint64_t(btr.unsafe_root()));
+  return true;
+}
+
+template <template <typename> class Transaction>
+bool
+ndb_ordered_index<Transaction>::reattach_root()
+{
+  uint64_t root;
+  if (!::allocator::GetRoot("btree:" + name, root))
+    return false;
+  btr.unsafe_reattach(reinterpret_cast<const void *>(root));
+  return true;
+}
+
 template <template <typename> class Transaction>
 std::map<std::string, uint64_t>
 ndb_ordered_index<Transaction>::clear()
@@ -322,6 +322,14 @@ protected: \
     rcu::s_instance.fault_region();
   }
 
+  // with --numa-placement, records of warehouse wid are allocated from the
+  // region of the cpu its partition is pinned to, no matter who loads them
+  static inline ssize_t
+  HomeCpuHint(unsigned int wid)
+  {
+    return numa_placement ? PartitionId(wid) : -1;
+  }
+
 public:
 
   static inline uint32_t
@@ -802,10 +810,16 @@ protected:
 
       if (pin_cpus)
         PinToWarehouseId(w);
+      const scoped_placement_hint ph(HomeCpuHint(w));
 
       for (uint b = 0; b < nbatches;) {
         scoped_str_arena s_arena(arena);
         void * const txn = db->new_txn(txn_flags, arena, txn_buf());
+#if !HASHTABLE
+        // with bulk loading, rows (generated in key order) are collected
+        // here and go in outside of txn
+        vector<pair<string, string>> stocks, stocks_data;
+#endif
         try {
           const size_t iend = std::min((b + 1) * batchsize + 1, NumItems());
           for (uint i = (b * batchsize + 1); i <= iend; i++) {
@@ -843,9 +857,35 @@ protected:
             const size_t sz = Size(v);
             stock_total_sz += sz;
             n_stocks++;
+#if !HASHTABLE
+            if (enable_bulk_loading) {
+              stocks.emplace_back(EncodeK(k), Encode(obj_buf, v));
+              stocks_data.emplace_back(EncodeK(k_data), Encode(obj_buf1, v_data));
+              continue;
+            }
+#endif
             tbl_stock(w)->insert(txn, EncodeK(k), Encode(obj_buf, v));
             tbl_stock_data(w)->insert(txn, EncodeK(k_data), Encode(obj_buf1, v_data));
           }
+#if !HASHTABLE
+          if (enable_bulk_loading) {
+            const ssize_t n = tbl_stock(w)->bulk_load(stocks);
+            if (n >= 0) {
+              // each stock key is generated exactly once
+              ALWAYS_ASSERT(size_t(n) == stocks.size());
+              ALWAYS_ASSERT(tbl_stock_data(w)->bulk_load(stocks_data) ==
+                            ssize_t(stocks_data.size()));
+              db->abort_txn(txn); // nothing went through it
+              b++;
+              continue;
+            }
+            // unsupported, so use the txn after all
+            for (auto &p : stocks)
+              tbl_stock(w)->insert(txn, p.first, p.second);
+            for (auto &p : stocks_data)
+              tbl_stock_data(w)->insert(txn, p.first, p.second);
+          }
+#endif
           if (db->commit_txn(txn)) {
             b++;
           } else {
@@ -901,6 +941,7 @@ protected:
       for (uint w = 1; w <= NumWarehouses(); w++) {
         if (pin_cpus)
           PinToWarehouseId(w);
+        const scoped_placement_hint ph(HomeCpuHint(w));
         for (uint d = 1; d <= NumDistrictsPerWarehouse(); d++, cnt++) {
           const district::key k(w, d);
 
@@ -980,6 +1021,7 @@ protected:
     for (uint w = w_start; w <= w_end; w++) {
       if (pin_cpus)
         PinToWarehouseId(w);
+      const scoped_placement_hint ph(HomeCpuHint(w));
       for (uint d = 1; d <= NumDistrictsPerWarehouse(); d++) {
         for (uint batch = 0; batch < nbatches;) {
           scoped_str_arena s_arena(arena);
@@ -1115,6 +1157,7 @@ protected:
     for (uint w = w_start; w <= w_end; w++) {
       if (pin_cpus)
         PinToWarehouseId(w);
+      const scoped_placement_hint ph(HomeCpuHint(w));
       for (uint d = 1; d <= NumDistrictsPerWarehouse(); d++) {
         set<uint> c_ids_s;
         vector<uint> c_ids;
@@ -1989,7 +2032,12 @@ private:
   UseHashtable(const char *name)
   {
 #if !HASHTABLE
-    return false;
+    // --use-hashtable: the tables which are only ever point accessed
+    // (only the ndb engines act on this without HASHTABLE)
+    return use_hashtable &&
+      (strcmp("warehouse", name) == 0 ||
+       strcmp("district", name) == 0 ||
+       strcmp("item", name) == 0);
 #endif
     return strcmp("customer", name) == 0 || 
 	   //strcmp("district", name) == 0 ||
@@ -2077,6 +2125,27 @@ public:
   }
 
 protected:
+  virtual size_t
+  migrate_tables()
+  {
+    // we only know where a record belongs when each partition has its own
+    // trees (XXX: decode the warehouse id from the key otherwise)
+    if (!g_enable_separate_tree_per_partition)
+      return 0;
+    size_t n = 0;
+    for (auto &t : partitions) {
+      if (IsTableReadOnly(t.first.c_str()))
+        continue;
+      set<abstract_ordered_index *> seen;
+      for (uint w = 1; w <= NumWarehouses(); w++) {
+        abstract_ordered_index * const idx = t.second[w - 1];
+        if (seen.insert(idx).second)
+          n += idx->migrate(PartitionId(w));
+      }
+    }
+    return n;
+  }
+
   virtual vector<bench_loader *>
   make_loaders()
   {
@@ -4,6 +4,10 @@
 #include <utility>
 #include <string>
 #include <set>
+#include <atomic>
+#include <cmath>
+#include <cctype>
+#include <cstring>
 
 #include <stdlib.h>
 #include <unistd.h>
@@ -25,10 +29,162 @@ using namespace util;
 static size_t nkeys;
 static const size_t YCSBRecordSize = 100;
 
-// [R, W, RMW, Scan]
+// [R, W, RMW, Scan, Insert]
 // we're missing remove for now
 // the default is a modification of YCSB "A" we made (80/20 R/W)
-static unsigned g_txn_workload_mix[] = { 80, 20, 0, 0 };
+static unsigned g_txn_workload_mix[] = { 80, 20, 0, 0, 0 };
+
+// scans cover [k, k + n) for n = g_max_scan_len, or for n uniform in
+// [1, g_max_scan_len] (YCSB "E")
+static size_t g_max_scan_len = 100;
+static int g_uniform_scan_len = 0;
+
+// inserts append keys from nkeys on
+static atomic<uint64_t> g_next_insert_key(0);
+
+/**
+ * The YCSB request distributions. Zipfian draws are O(1), using the method
+ * of Gray et al, "Quickly Generating Billion-Record Synthetic Databases"-
+ * the O(nkeys) zeta sum is computed once, up front:
+ *
+ *   zipfian           : key i with probability ~ 1/(i+1)^theta, so the hot
+ *                       keys are the low ones (and neighbors)
+ *   scrambled-zipfian : same popularity, but the hot keys are hashed all
+ *                       over the key space
+ *   latest            : zipfian over the age of a key- the most recently
+ *                       inserted ones are the hottest
+ *   hotspot           : hot_op_frac of the requests go (uniformly) to the
+ *                       first hot_set_frac of the keys, the rest uniformly
+ *                       to the others
+ */
+class ycsb_key_chooser {
+public:
+  enum dist {
+    DIST_UNIFORM,
+    DIST_ZIPFIAN,
+    DIST_SCRAMBLED_ZIPFIAN,
+    DIST_LATEST,
+    DIST_HOTSPOT,
+  };
+
+  ycsb_key_chooser()
+    : d(DIST_UNIFORM), n(0), theta(0.99), hot_set_frac(0.2), hot_op_frac(0.8),
+      zetan(0), alpha(0), eta(0), half_pow_theta(0) {}
+
+  void
+  init(dist d, uint64_t n)
+  {
+    ALWAYS_ASSERT(n > 0);
+    ALWAYS_ASSERT(theta > 0.0 && theta < 1.0);
+    this->d = d;
+    this->n = n;
+    if (d == DIST_UNIFORM || d == DIST_HOTSPOT)
+      return;
+    zetan = zeta(n, theta);
+    alpha = 1.0 / (1.0 - theta);
+    eta = (1.0 - pow(2.0 / double(n), 1.0 - theta)) /
+          (1.0 - zeta(2, theta) / zetan);
+    half_pow_theta = 1.0 + pow(0.5, theta);
+  }
+
+  inline uint64_t
+  next(fast_random &r) const
+  {
+    switch (d) {
+    case DIST_UNIFORM:
+      return r.next() % n;
+    case DIST_ZIPFIAN:
+      return next_zipf(r);
+    case DIST_SCRAMBLED_ZIPFIAN:
+      return fnv64(next_zipf(r)) % n;
+    case DIST_LATEST:
+      {
+        // XXX: the popularity curve is over the initial nkeys, not
+        // recomputed as the table grows
+        const uint64_t last =
+          g_next_insert_key.load(memory_order_relaxed) - 1;
+        const uint64_t age = next_zipf(r);
+        return age > last ? 0 : last - age;
+      }
+    case DIST_HOTSPOT:
+      {
+        const uint64_t nhot =
+          max(uint64_t(1), min(n, uint64_t(double(n) * hot_set_frac)));
+        if (nhot == n || r.next_uniform() < hot_op_frac)
+          return r.next() % nhot;
+        return nhot + r.next() % (n - nhot);
+      }
+    }
+    ALWAYS_ASSERT(false);
+    return 0;
+  }
+
+  static bool
+  parse(const string &s, dist &d)
+  {
+    if (s == "uniform")
+      d = DIST_UNIFORM;
+    else if (s == "zipfian")
+      d = DIST_ZIPFIAN;
+    else if (s == "scrambled-zipfian")
+      d = DIST_SCRAMBLED_ZIPFIAN;
+    else if (s == "latest")
+      d = DIST_LATEST;
+    else if (s == "hotspot")
+      d = DIST_HOTSPOT;
+    else
+      return false;
+    return true;
+  }
+
+  dist d;
+  uint64_t n;
+  double theta;
+  double hot_set_frac;
+  double hot_op_frac;
+
+private:
+
+  inline uint64_t
+  next_zipf(fast_random &r) const
+  {
+    const double u = r.next_uniform();
+    const double uz = u * zetan;
+    if (uz < 1.0)
+      return 0;
+    if (uz < half_pow_theta)
+      return 1;
+    const uint64_t ret = uint64_t(double(n) * pow(eta * u - eta + 1.0, alpha));
+    return min(ret, n - 1);
+  }
+
+  static double
+  zeta(uint64_t n, double theta)
+  {
+    double sum = 0.0;
+    for (uint64_t i = 1; i <= n; i++)
+      sum += 1.0 / pow(double(i), theta);
+    return sum;
+  }
+
+  static inline uint64_t
+  fnv64(uint64_t v)
+  {
+    uint64_t h = 0xcbf29ce484222325UL;
+    for (size_t i = 0; i < sizeof(v); i++) {
+      h ^= (v >> (i * 8)) & 0xff;
+      h *= 0x100000001b3UL;
+    }
+    return h;
+  }
+
+  double zetan;
+  double alpha;
+  double eta;
+  double half_pow_theta;
+};
+
+static ycsb_key_chooser g_key_chooser;
 
 class ycsb_worker : public bench_worker {
 public:
@@ -52,8 +208,10 @@ public:
     void * const txn = db->new_txn(txn_flags, arena, txn_buf(), abstract_db::HINT_KV_GET_PUT);
     scoped_str_arena s_arena(arena);
     try {
-      const uint64_t k = r.next() % nkeys;
-      ALWAYS_ASSERT(tbl->get(txn, u64_varkey(k).str(obj_key0), obj_v));
+      const uint64_t k = g_key_chooser.next(r);
+      // an appended key may not have committed yet (or ever)
+      ALWAYS_ASSERT(tbl->get(txn, u64_varkey(k).str(obj_key0), obj_v) ||
+                    k >= nkeys);
       computation_n += obj_v.size();
       measure_txn_counters(txn, "txn_read");
       if (likely(db->commit_txn(txn)))
@@ -76,7 +234,7 @@ public:
     void * const txn = db->new_txn(txn_flags, arena, txn_buf(), abstract_db::HINT_KV_GET_PUT);
     scoped_str_arena s_arena(arena);
     try {
-      auto s = u64_varkey(r.next() % nkeys).str(str());
+      auto s = u64_varkey(g_key_chooser.next(r)).str(str());
       auto s2 = str().assign(YCSBRecordSize, 'b');
       tbl->put(txn, s, s2);
       measure_txn_counters(txn, "txn_write");
@@ -100,10 +258,14 @@ public:
     void * const txn = db->new_txn(txn_flags, arena, txn_buf(), abstract_db::HINT_KV_RMW);
     scoped_str_arena s_arena(arena);
     try {
-      const uint64_t key = r.next() % nkeys;
-      ALWAYS_ASSERT(tbl->get(txn, u64_varkey(key).str(obj_key0), obj_v));
-      computation_n += obj_v.size();
-      tbl->put(txn, obj_key0, str().assign(YCSBRecordSize, 'c'));
+      const uint64_t key = g_key_chooser.next(r);
+      if (tbl->get(txn, u64_varkey(key).str(obj_key0), obj_v)) {
+        computation_n += obj_v.size();
+        tbl->put(txn, obj_key0, str().assign(YCSBRecordSize, 'c'));
+      } else {
+        // see txn_read()
+        ALWAYS_ASSERT(key >= nkeys);
+      }
       measure_txn_counters(txn, "txn_rmw");
       if (likely(db->commit_txn(txn)))
         return txn_result(true, 0);
@@ -136,9 +298,11 @@ public:
   {
     void * const txn = db->new_txn(txn_flags, arena, txn_buf(), abstract_db::HINT_KV_SCAN);
     scoped_str_arena s_arena(arena);
-    const size_t kstart = r.next() % nkeys;
+    const size_t kstart = g_key_chooser.next(r);
+    const size_t len = g_uniform_scan_len ?
+      1 + r.next() % g_max_scan_len : g_max_scan_len;
     const string &kbegin = u64_varkey(kstart).str(obj_key0);
-    const string &kend = u64_varkey(kstart + 100).str(obj_key1);
+    const string &kend = u64_varkey(kstart + len).str(obj_key1);
     worker_scan_callback c;
     try {
       tbl->scan(txn, kbegin, &kend, c);
@@ -158,6 +322,29 @@ public:
     return static_cast<ycsb_worker *>(w)->txn_scan();
   }
 
+  txn_result
+  txn_insert()
+  {
+    void * const txn = db->new_txn(txn_flags, arena, txn_buf(), abstract_db::HINT_KV_GET_PUT);
+    scoped_str_arena s_arena(arena);
+    try {
+      const uint64_t k = g_next_insert_key.fetch_add(1, memory_order_relaxed);
+      tbl->insert(txn, u64_varkey(k).str(str()), str().assign(YCSBRecordSize, 'd'));
+      measure_txn_counters(txn, "txn_insert");
+      if (likely(db->commit_txn(txn)))
+        return txn_result(true, YCSBRecordSize);
+    } catch (abstract_db::abstract_abort_exception &ex) {
+      db->abort_txn(txn);
+    }
+    return txn_result(false, 0);
+  }
+
+  static txn_result
+  TxnInsert(bench_worker *w)
+  {
+    return static_cast<ycsb_worker *>(w)->txn_insert();
+  }
+
   virtual workload_desc_vec
   get_workload() const
   {
@@ -189,6 +376,8 @@ public:
       w.push_back(workload_desc("ReadModifyWrite",  double(g_txn_workload_mix[2])/100.0, TxnRmw));
     if (g_txn_workload_mix[3])
       w.push_back(workload_desc("Scan",  double(g_txn_workload_mix[3])/100.0, TxnScan));
+    if (g_txn_workload_mix[4])
+      w.push_back(workload_desc("Insert",  double(g_txn_workload_mix[4])/100.0, TxnInsert));
     return w;
   }
 
@@ -243,11 +432,26 @@ ycsb_load_keyrange(
   ALWAYS_ASSERT(nkeys > 0);
   const size_t nbatches = nkeys < batchsize ? 1 : (nkeys / batchsize);
   for (size_t batchid = 0; batchid < nbatches;) {
+    const size_t rend = (batchid + 1 == nbatches) ?
+      keyend : keystart + ((batchid + 1) * batchsize);
+    if (enable_bulk_loading) {
+      // u64_varkey()s sort numerically, so this is already in key order
+      vector<pair<string, string>> records;
+      records.reserve(rend - (batchid * batchsize + keystart));
+      for (size_t i = batchid * batchsize + keystart; i < rend; i++)
+        records.emplace_back(
+            u64_varkey(i).str(), string(YCSBRecordSize, 'a'));
+      const ssize_t n = tbl->bulk_load(records);
+      if (n >= 0) {
+        // the key ranges of the loaders are disjoint
+        ALWAYS_ASSERT(size_t(n) == records.size());
+        batchid++;
+        continue;
+      }
+    }
     scoped_str_arena s_arena(arena);
     void * const txn = db->new_txn(txn_flags, arena, txn_buf);
     try {
-      const size_t rend = (batchid + 1 == nbatches) ?
-        keyend : keystart + ((batchid + 1) * batchsize);
       for (size_t i = batchid * batchsize + keystart; i < rend; i++) {
         ALWAYS_ASSERT(i >= keystart && i < keyend);
         const string k = u64_varkey(i).str();
@@ -461,21 +665,59 @@ private:
 
 };
 
+// the standard YCSB core workloads, as [R, W, RMW, Scan, Insert] mixes
+// (W being YCSB's "update")
+struct ycsb_preset {
+  char name;
+  unsigned mix[ARRAY_NELEMS(g_txn_workload_mix)];
+  ycsb_key_chooser::dist dist;
+  bool uniform_scan_len;
+};
+
+static const ycsb_preset g_presets[] = {
+  {'A', {50, 50, 0, 0, 0}, ycsb_key_chooser::DIST_ZIPFIAN, false},
+  {'B', {95, 5, 0, 0, 0}, ycsb_key_chooser::DIST_ZIPFIAN, false},
+  {'C', {100, 0, 0, 0, 0}, ycsb_key_chooser::DIST_ZIPFIAN, false},
+  {'D', {95, 0, 0, 0, 5}, ycsb_key_chooser::DIST_LATEST, false},
+  {'E', {0, 0, 0, 95, 5}, ycsb_key_chooser::DIST_ZIPFIAN, true},
+  {'F', {50, 0, 50, 0, 0}, ycsb_key_chooser::DIST_ZIPFIAN, false},
+};
+
+static const char *
+dist_name(ycsb_key_chooser::dist d)
+{
+  switch (d) {
+  case ycsb_key_chooser::DIST_UNIFORM: return "uniform";
+  case ycsb_key_chooser::DIST_ZIPFIAN: return "zipfian";
+  case ycsb_key_chooser::DIST_SCRAMBLED_ZIPFIAN: return "scrambled-zipfian";
+  case ycsb_key_chooser::DIST_LATEST: return "latest";
+  case ycsb_key_chooser::DIST_HOTSPOT: return "hotspot";
+  }
+  return "unknown";
+}
+
 void
 ycsb_do_test(abstract_db *db, int argc, char **argv)
 {
   nkeys = size_t(scale_factor * 1000.0);
   ALWAYS_ASSERT(nkeys > 0);
+  g_next_insert_key.store(nkeys);
 
-  // parse options
+  // parse options- later options override what a --workload preset set
+  ycsb_key_chooser::dist dist = ycsb_key_chooser::DIST_UNIFORM;
   optind = 1;
   while (1) {
     static struct option long_options[] = {
       {"workload-mix" , required_argument , 0 , 'w'},
+      {"workload"     , required_argument , 0 , 'p'}, // A-F
+      {"distribution" , required_argument , 0 , 'd'},
+      {"zipf-theta"   , required_argument , 0 , 'z'},
+      {"hotspot"      , required_argument , 0 , 'h'}, // set_frac,op_frac
+      {"max-scan-len" , required_argument , 0 , 'l'},
       {0, 0, 0, 0}
     };
     int option_index = 0;
-    int c = getopt_long(argc, argv, "w:", long_options, &option_index);
+    int c = getopt_long(argc, argv, "w:p:d:z:h:l:", long_options, &option_index);
     if (c == -1)
       break;
     switch (c) {
@@ -488,10 +730,13 @@ ycsb_do_test(abstract_db *db, int argc, char **argv)
     case 'w':
       {
         const vector<string> toks = split(optarg, ',');
-        ALWAYS_ASSERT(toks.size() == ARRAY_NELEMS(g_txn_workload_mix));
+        // the insert share may be left off
+        ALWAYS_ASSERT(toks.size() == ARRAY_NELEMS(g_txn_workload_mix) ||
+                      toks.size() == ARRAY_NELEMS(g_txn_workload_mix) - 1);
         unsigned s = 0;
-        for (size_t i = 0; i < toks.size(); i++) {
-          unsigned p = strtoul(toks[i].c_str(), nullptr, 10);
+        for (size_t i = 0; i < ARRAY_NELEMS(g_txn_workload_mix); i++) {
+          unsigned p = i < toks.size() ?
+            strtoul(toks[i].c_str(), nullptr, 10) : 0;
           ALWAYS_ASSERT(p >= 0 && p <= 100);
           s += p;
           g_txn_workload_mix[i] = p;
@@ -500,6 +745,53 @@ ycsb_do_test(abstract_db *db, int argc, char **argv)
       }
       break;
 
+    case 'p':
+      {
+        const ycsb_preset *p = nullptr;
+        for (size_t i = 0; i < ARRAY_NELEMS(g_presets); i++)
+          if (strlen(optarg) == 1 && toupper(optarg[0]) == g_presets[i].name)
+            p = &g_presets[i];
+        if (!p) {
+          cerr << "[ERROR] unknown ycsb workload " << optarg
+               << " (want one of A-F)" << endl;
+          exit(1);
+        }
+        NDB_MEMCPY(g_txn_workload_mix, p->mix, sizeof(g_txn_workload_mix));
+        dist = p->dist;
+        g_uniform_scan_len = p->uniform_scan_len;
+      }
+      break;
+
+    case 'd':
+      if (!ycsb_key_chooser::parse(optarg, dist)) {
+        cerr << "[ERROR] unknown ycsb distribution " << optarg << endl;
+        exit(1);
+      }
+      break;
+
+    case 'z':
+      g_key_chooser.theta = strtod(optarg, nullptr);
+      ALWAYS_ASSERT(g_key_chooser.theta > 0.0 && g_key_chooser.theta < 1.0);
+      break;
+
+    case 'h':
+      {
+        const vector<string> toks = split(optarg, ',');
+        ALWAYS_ASSERT(toks.size() == 2);
+        g_key_chooser.hot_set_frac = strtod(toks[0].c_str(), nullptr);
+        g_key_chooser.hot_op_frac = strtod(toks[1].c_str(), nullptr);
+        ALWAYS_ASSERT(g_key_chooser.hot_set_frac > 0.0 &&
+                      g_key_chooser.hot_set_frac <= 1.0);
+        ALWAYS_ASSERT(g_key_chooser.hot_op_frac >= 0.0 &&
+                      g_key_chooser.hot_op_frac <= 1.0);
+      }
+      break;
+
+    case 'l':
+      g_max_scan_len = strtoul(optarg, nullptr, 10);
+      ALWAYS_ASSERT(g_max_scan_len > 0);
+      break;
+
     case '?':
       /* getopt_long already printed an error message. */
       exit(1);
@@ -509,11 +801,25 @@ ycsb_do_test(abstract_db *db, int argc, char **argv)
     }
   }
 
+  {
+    scoped_timer t("ycsb key distribution setup", verbose);
+    g_key_chooser.init(dist, nkeys);
+  }
+
   if (verbose) {
     cerr << "ycsb settings:" << endl;
     cerr << "  workload_mix: "
          << format_list(g_txn_workload_mix, g_txn_workload_mix + ARRAY_NELEMS(g_txn_workload_mix))
          << endl;
+    cerr << "  distribution: " << dist_name(dist) << endl;
+    if (dist != ycsb_key_chooser::DIST_UNIFORM &&
+        dist != ycsb_key_chooser::DIST_HOTSPOT)
+      cerr << "  zipf_theta: " << g_key_chooser.theta << endl;
+    if (dist == ycsb_key_chooser::DIST_HOTSPOT)
+      cerr << "  hotspot: " << g_key_chooser.hot_set_frac << ","
+           << g_key_chooser.hot_op_frac << endl;
+    cerr << "  max_scan_len: " << g_max_scan_len
+         << (g_uniform_scan_len ? " (uniform)" : "") << endl;
   }
 
   ycsb_bench_runner r(db);
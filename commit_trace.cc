@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include <unistd.h>
+
+#include "commit_trace.h"
+#include "util.h"
+
+using namespace std;
+using namespace util;
+
+unsigned commit_trace::g_sample_period = 0;
+percore<commit_trace::core_ctx> commit_trace::g_ctxs;
+commit_trace::epoch_entry commit_trace::g_durable[EpochRingSize];
+
+commit_trace::record *
+commit_trace::begin_slow(core_ctx &c, size_t nreads, size_t nwrites)
+{
+  if (unlikely(!c.ring_))
+    c.ring_ = new record[RingSize];
+  record * const r = &c.ring_[c.head_++ % RingSize];
+  NDB_MEMSET(r, 0, sizeof(*r));
+  r->core_ = coreid::core_id();
+  r->nreads_ = nreads;
+  r->nwrites_ = nwrites;
+  r->ts_[PHASE_BEGIN] = rdtsc();
+  c.cur_ = r;
+  return r;
+}
+
+void
+commit_trace::buffer_written(unsigned core, uint64_t last_tid, uint64_t tsc)
+{
+  if (likely(!g_sample_period))
+    return;
+  core_ctx &c = g_ctxs[core];
+  if (unlikely(!c.log_ring_))
+    c.log_ring_ = new log_entry[LogRingSize];
+  log_entry &e = c.log_ring_[c.log_head_++ % LogRingSize];
+  e.last_tid_ = last_tid;
+  e.tsc_ = tsc;
+}
+
+void
+commit_trace::epochs_durable(uint64_t first, uint64_t last, uint64_t tsc)
+{
+  if (likely(!g_sample_period))
+    return;
+  for (uint64_t e = first; e <= last; e++) {
+    epoch_entry &d = g_durable[e % EpochRingSize];
+    d.epoch_ = e;
+    d.tsc_ = tsc;
+  }
+}
+
+static double
+calibrate_ticks_per_us()
+{
+  timer t;
+  const uint64_t t0 = rdtsc();
+  usleep(100000);
+  const uint64_t t1 = rdtsc();
+  return double(t1 - t0) / double(t.lap());
+}
+
+size_t
+commit_trace::dump(const string &fname)
+{
+  vector<record> recs;
+  for (size_t i = 0; i < coreid::NMaxCores; i++) {
+    const core_ctx &c = g_ctxs[i];
+    if (!c.ring_)
+      continue;
+    // the buffer writes in the ring, oldest first. tids (and so the
+    // last_tid_ of each buffer) increase on any one core
+    vector<log_entry> writes;
+    const bool wrapped = c.log_head_ > LogRingSize;
+    if (c.log_ring_) {
+      const uint64_t n = min(c.log_head_, uint64_t(LogRingSize));
+      for (uint64_t j = c.log_head_ - n; j < c.log_head_; j++)
+        writes.push_back(c.log_ring_[j % LogRingSize]);
+    }
+    const uint64_t n = min(c.head_, uint64_t(RingSize));
+    for (uint64_t j = c.head_ - n; j < c.head_; j++) {
+      record r = c.ring_[j % RingSize];
+      if (r.committed_ && r.epoch_) {
+        // the first buffer written which holds tids up to r's
+        auto it = lower_bound(
+            writes.begin(), writes.end(), r.tid_,
+            [](const log_entry &e, uint64_t tid) { return e.last_tid_ < tid; });
+        // if the ring wrapped, the oldest entry left might not be r's
+        if (it != writes.end() && (it != writes.begin() || !wrapped))
+          r.ts_[PHASE_LOG_WRITTEN] = it->tsc_;
+        const epoch_entry &d = g_durable[r.epoch_ % EpochRingSize];
+        if (d.epoch_ == r.epoch_)
+          r.ts_[PHASE_DURABLE] = d.tsc_;
+      }
+      recs.push_back(r);
+    }
+  }
+
+  file_header hdr;
+  hdr.magic_ = file_header::Magic;
+  hdr.ticks_per_us_ = calibrate_ticks_per_us();
+  hdr.nrecords_ = recs.size();
+  ofstream ofs(fname.c_str(), ofstream::binary);
+  if (!ofs) {
+    cerr << "could not open " << fname << endl;
+    return 0;
+  }
+  ofs.write((const char *) &hdr, sizeof(hdr));
+  if (!recs.empty())
+    ofs.write((const char *) &recs[0], recs.size() * sizeof(recs[0]));
+  return recs.size();
+}
@@ -0,0 +1,169 @@
+#ifndef _NDB_COMMIT_TRACE_H_
+#define _NDB_COMMIT_TRACE_H_
+
+#include <stdint.h>
+#include <string>
+
+#include "amd64.h"
+#include "core.h"
+#include "macros.h"
+
+/**
+ * Runtime sampled tracing of the commit path: one in g_sample_period
+ * commits on each core records the TSC as it passes each phase below, into
+ * a per-core ring of the most recent RingSize such records. When disabled,
+ * this costs one predictable branch per commit.
+ *
+ * A txn's log write and durability happen on the logger threads, which
+ * record (per core) the last tid of each buffer written and (globally) the
+ * TSC at which each epoch became durable. dump() matches these up w/ the
+ * sampled records- see commit_trace_dump for reading the result
+ */
+class commit_trace {
+public:
+
+  enum phase {
+    PHASE_BEGIN = 0,    // commit() entered
+    PHASE_LOCKED,       // write set locked
+    PHASE_TID,          // commit tid generated
+    PHASE_VALIDATED,    // read set validated
+    PHASE_WRITTEN,      // records installed, write set unlocked
+    PHASE_LOG_ENQUEUED, // log entry placed in the core's log buffer
+    PHASE_LOG_WRITTEN,  // the log buffer holding the entry was written
+    PHASE_DURABLE,      // the txn's epoch became durable
+    NPHASES,
+  };
+
+  static const char *
+  PhaseStr(phase p)
+  {
+    switch (p) {
+    case PHASE_BEGIN:        return "begin";
+    case PHASE_LOCKED:       return "locked";
+    case PHASE_TID:          return "tid";
+    case PHASE_VALIDATED:    return "validated";
+    case PHASE_WRITTEN:      return "written";
+    case PHASE_LOG_ENQUEUED: return "log_enqueued";
+    case PHASE_LOG_WRITTEN:  return "log_written";
+    case PHASE_DURABLE:      return "durable";
+    default:
+      break;
+    }
+    ALWAYS_ASSERT(false);
+    return 0;
+  }
+
+  struct record {
+    uint64_t tid_;         // 0 if the txn got no commit tid
+    uint64_t epoch_;       // 0 unless the txn was logged
+    uint64_t ts_[NPHASES]; // tsc, 0 if the phase was not reached
+    uint32_t core_;
+    uint32_t nreads_;
+    uint32_t nwrites_;
+    uint32_t committed_;
+  };
+
+  // the dump file is a file_header, then nrecords_ records
+  struct file_header {
+    static const uint64_t Magic = 0x4354524143453031UL; // "CTRACE01"
+    uint64_t magic_;
+    double ticks_per_us_;
+    uint64_t nrecords_;
+  };
+
+  static const size_t RingSize = 4096;
+  static const size_t LogRingSize = 4096;
+  static const size_t EpochRingSize = 4096;
+
+  // 0 disables tracing. set before any worker starts
+  static unsigned g_sample_period;
+
+  // returns the record to fill in for this commit, or null if the commit
+  // is not sampled
+  static inline ALWAYS_INLINE record *
+  begin(size_t nreads, size_t nwrites)
+  {
+    if (likely(!g_sample_period))
+      return nullptr;
+    core_ctx &c = g_ctxs.my();
+    if (++c.ncommits_ % g_sample_period)
+      return nullptr;
+    return begin_slow(c, nreads, nwrites);
+  }
+
+  static inline ALWAYS_INLINE void
+  mark(record *r, phase p)
+  {
+    if (unlikely(r))
+      r->ts_[p] = rdtsc();
+  }
+
+  // for the log enqueue, which happens inside the protocol's
+  // on_tid_finish(), between begin() and end() on the same core
+  static inline ALWAYS_INLINE void
+  log_enqueued(uint64_t epoch)
+  {
+    if (likely(!g_sample_period))
+      return;
+    record * const r = g_ctxs.my().cur_;
+    if (!r)
+      return;
+    r->epoch_ = epoch;
+    r->ts_[PHASE_LOG_ENQUEUED] = rdtsc();
+  }
+
+  static inline ALWAYS_INLINE void
+  end(record *r, bool committed, uint64_t tid)
+  {
+    if (likely(!r))
+      return;
+    r->committed_ = committed;
+    r->tid_ = tid;
+    g_ctxs.my().cur_ = nullptr;
+  }
+
+  // called by the logger which owns core's buffers, once the buffer ending
+  // in last_tid is written
+  static void buffer_written(unsigned core, uint64_t last_tid, uint64_t tsc);
+
+  // called by the logger once epochs [first, last] are durable
+  static void epochs_durable(uint64_t first, uint64_t last, uint64_t tsc);
+
+  // writes out every sampled record, filling in the log write and durable
+  // timestamps where they are known. only call once the system is
+  // quiescent. returns the number of records written
+  static size_t dump(const std::string &fname);
+
+private:
+
+  struct log_entry {
+    uint64_t last_tid_;
+    uint64_t tsc_;
+  };
+
+  struct core_ctx {
+    core_ctx()
+      : ncommits_(0), ring_(nullptr), head_(0), cur_(nullptr),
+        log_ring_(nullptr), log_head_(0) {}
+    // written by the worker on this core
+    uint64_t ncommits_;
+    record *ring_;
+    uint64_t head_;
+    record *cur_;
+    // written by the logger for this core
+    log_entry *log_ring_;
+    uint64_t log_head_;
+  };
+
+  struct epoch_entry {
+    uint64_t epoch_;
+    uint64_t tsc_;
+  };
+
+  static record *begin_slow(core_ctx &c, size_t nreads, size_t nwrites);
+
+  static percore<core_ctx> g_ctxs CACHE_ALIGNED;
+  static epoch_entry g_durable[EpochRingSize];
+};
+
+#endif /* _NDB_COMMIT_TRACE_H_ */
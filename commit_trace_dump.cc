@@ -0,0 +1,153 @@
+/**
+ * commit_trace_dump.cc
+ *
+ * stand-alone tool to read the file written by commit_trace::dump()
+ *
+ * prints, per commit phase, the distribution of the time spent getting
+ * there from the previous phase reached- over all sampled commits, and over
+ * the slowest ones only, to see which phases the tail comes from. with -v,
+ * also prints every record
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <string.h>
+
+#include "commit_trace.h"
+#include "histogram.h"
+
+using namespace std;
+
+typedef commit_trace::record record;
+
+static inline uint64_t
+to_us(uint64_t ticks, double ticks_per_us)
+{
+  return uint64_t(double(ticks) / ticks_per_us);
+}
+
+// the last phase r reached
+static inline uint64_t
+end_ts(const record &r)
+{
+  for (int p = commit_trace::NPHASES - 1; p >= 0; p--)
+    if (r.ts_[p])
+      return r.ts_[p];
+  return r.ts_[commit_trace::PHASE_BEGIN];
+}
+
+static void
+summarize(const vector<const record *> &recs, double ticks_per_us)
+{
+  log_linear_histogram hists[commit_trace::NPHASES];
+  log_linear_histogram total;
+  for (auto r : recs) {
+    uint64_t prev = r->ts_[commit_trace::PHASE_BEGIN];
+    for (size_t p = 1; p < commit_trace::NPHASES; p++) {
+      if (!r->ts_[p])
+        continue;
+      // the logger's timestamps come from another core
+      const uint64_t d = r->ts_[p] > prev ? r->ts_[p] - prev : 0;
+      hists[p].record(to_us(d, ticks_per_us));
+      prev = r->ts_[p];
+    }
+    total.record(to_us(end_ts(*r) - r->ts_[commit_trace::PHASE_BEGIN],
+                       ticks_per_us));
+  }
+  for (size_t p = 1; p < commit_trace::NPHASES; p++) {
+    if (!hists[p].count())
+      continue;
+    cout << "  " << commit_trace::PhaseStr(commit_trace::phase(p))
+         << " (n=" << hists[p].count() << ", mean=" << hists[p].mean()
+         << "): ";
+    hists[p].print_percentiles(cout);
+    cout << endl;
+  }
+  cout << "  total (n=" << total.count() << ", mean=" << total.mean()
+       << "): ";
+  total.print_percentiles(cout);
+  cout << endl;
+}
+
+int
+main(int argc, char **argv)
+{
+  bool verbose = false;
+  double tail_pct = 1.0;
+  string fname;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-v"))
+      verbose = true;
+    else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+      tail_pct = strtod(argv[++i], nullptr);
+    else
+      fname = argv[i];
+  }
+  if (fname.empty() || tail_pct <= 0.0 || tail_pct > 100.0) {
+    cerr << "[usage] " << argv[0] << " [-v] [-t tail_pct] tracefile" << endl;
+    return 1;
+  }
+
+  ifstream ifs(fname.c_str(), ifstream::binary);
+  commit_trace::file_header hdr;
+  if (!ifs.read((char *) &hdr, sizeof(hdr)) ||
+      hdr.magic_ != commit_trace::file_header::Magic) {
+    cerr << "not a commit trace: " << fname << endl;
+    return 1;
+  }
+  vector<record> recs(hdr.nrecords_);
+  if (hdr.nrecords_ &&
+      !ifs.read((char *) &recs[0], recs.size() * sizeof(recs[0]))) {
+    cerr << "truncated commit trace: " << fname << endl;
+    return 1;
+  }
+
+  if (verbose) {
+    cout << "# core tid epoch committed nreads nwrites";
+    for (size_t p = 1; p < commit_trace::NPHASES; p++)
+      cout << " " << commit_trace::PhaseStr(commit_trace::phase(p)) << "_us";
+    cout << endl;
+    for (auto &r : recs) {
+      cout << r.core_ << " " << r.tid_ << " " << r.epoch_ << " "
+           << r.committed_ << " " << r.nreads_ << " " << r.nwrites_;
+      // since begin, -1 if not reached
+      for (size_t p = 1; p < commit_trace::NPHASES; p++) {
+        if (!r.ts_[p] || r.ts_[p] < r.ts_[commit_trace::PHASE_BEGIN])
+          cout << " -1";
+        else
+          cout << " " << to_us(r.ts_[p] - r.ts_[commit_trace::PHASE_BEGIN],
+                               hdr.ticks_per_us_);
+      }
+      cout << endl;
+    }
+  }
+
+  vector<const record *> committed;
+  for (auto &r : recs)
+    if (r.committed_)
+      committed.push_back(&r);
+  cout << recs.size() << " sampled commits, " << committed.size()
+       << " committed (" << hdr.ticks_per_us_ << " ticks/us)" << endl;
+  if (committed.empty())
+    return 0;
+
+  cout << "time spent reaching each phase (us), all:" << endl;
+  summarize(committed, hdr.ticks_per_us_);
+
+  sort(committed.begin(), committed.end(),
+      [](const record *a, const record *b) {
+        return end_ts(*a) - a->ts_[commit_trace::PHASE_BEGIN] >
+               end_ts(*b) - b->ts_[commit_trace::PHASE_BEGIN];
+      });
+  const size_t ntail =
+    max(size_t(1), size_t(double(committed.size()) * tail_pct / 100.0));
+  committed.resize(ntail);
+  cout << "time spent reaching each phase (us), slowest "
+       << tail_pct << "%:" << endl;
+  summarize(committed, hdr.ticks_per_us_);
+  return 0;
+}
@@ -0,0 +1,117 @@
+#include <algorithm>
+
+#include <string.h>
+
+#include "conflict_sampler.h"
+#include "lockguard.h"
+
+using namespace std;
+
+bool conflict_sampler::g_enabled = false;
+percore<conflict_sampler::sketch> conflict_sampler::g_sketches;
+event_counter conflict_sampler::g_evt_samples("conflict_samples");
+event_counter conflict_sampler::g_evt_unattributed("conflict_samples_unattributed");
+
+static spinlock g_tables_lock;
+static map<const void *, string> g_tables;
+
+void
+conflict_sampler::register_table(const void *table, const string &name)
+{
+  lock_guard<spinlock> l(g_tables_lock);
+  g_tables[table] = name;
+}
+
+void
+conflict_sampler::unregister_table(const void *table)
+{
+  lock_guard<spinlock> l(g_tables_lock);
+  g_tables.erase(table);
+}
+
+void
+conflict_sampler::offer_slow(const void *table, const char *key, size_t keylen)
+{
+  ++g_evt_samples;
+  keylen = min(keylen, size_t(MaxKeyLength));
+  sketch &s = g_sketches.my();
+  lock_guard<spinlock> l(s.lock_);
+  if (unlikely(!s.slots_))
+    s.slots_ = new slot[K];
+  // aborts are rare next to commits, so a linear scan over K is fine
+  slot *victim = nullptr;
+  for (size_t i = 0; i < s.nused_; i++) {
+    slot &e = s.slots_[i];
+    if (e.table_ == table && e.keylen_ == keylen &&
+        !memcmp(&e.key_[0], key, keylen)) {
+      e.count_++;
+      return;
+    }
+    if (!victim || e.count_ < victim->count_)
+      victim = &e;
+  }
+  if (s.nused_ < K) {
+    slot &e = s.slots_[s.nused_++];
+    e.table_ = table;
+    e.count_ = 1;
+    e.error_ = 0;
+    e.keylen_ = keylen;
+    NDB_MEMCPY(&e.key_[0], key, keylen);
+    return;
+  }
+  // space-saving: the newcomer inherits the smallest count as its error
+  INVARIANT(victim);
+  victim->table_ = table;
+  victim->error_ = victim->count_;
+  victim->count_++;
+  victim->keylen_ = keylen;
+  NDB_MEMCPY(&victim->key_[0], key, keylen);
+}
+
+map<string, vector<conflict_sampler::entry>>
+conflict_sampler::top(size_t n)
+{
+  // summing the per-core counts (and errors) keeps the error bound
+  map<pair<const void *, string>, pair<uint64_t, uint64_t>> merged;
+  for (size_t i = 0; i < coreid::NMaxCores; i++) {
+    sketch &s = g_sketches[i];
+    lock_guard<spinlock> l(s.lock_);
+    for (size_t j = 0; j < s.nused_; j++) {
+      const slot &e = s.slots_[j];
+      auto &m = merged[make_pair(e.table_, string(&e.key_[0], e.keylen_))];
+      m.first += e.count_;
+      m.second += e.error_;
+    }
+  }
+
+  map<string, vector<entry>> ret;
+  {
+    lock_guard<spinlock> l(g_tables_lock);
+    for (auto &p : merged) {
+      auto it = g_tables.find(p.first.first);
+      entry e;
+      e.table_ = it == g_tables.end() ? "<unknown>" : it->second;
+      e.key_ = p.first.second;
+      e.count_ = p.second.first;
+      e.error_ = p.second.second;
+      ret[e.table_].push_back(e);
+    }
+  }
+  for (auto &p : ret) {
+    sort(p.second.begin(), p.second.end(),
+        [](const entry &a, const entry &b) { return a.count_ > b.count_; });
+    if (p.second.size() > n)
+      p.second.resize(n);
+  }
+  return ret;
+}
+
+void
+conflict_sampler::reset()
+{
+  for (size_t i = 0; i < coreid::NMaxCores; i++) {
+    sketch &s = g_sketches[i];
+    lock_guard<spinlock> l(s.lock_);
+    s.nused_ = 0;
+  }
+}
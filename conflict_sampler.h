@@ -0,0 +1,89 @@
+#ifndef _NDB_CONFLICT_SAMPLER_H_
+#define _NDB_CONFLICT_SAMPLER_H_
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "core.h"
+#include "counter.h"
+#include "macros.h"
+#include "spinlock.h"
+
+/**
+ * Which keys do commits conflict on? When enabled, every commit which fails
+ * on a specific record (read validation, or locking its write set) offers
+ * the record's (table, key) to a per-core space-saving top-K sketch. top()
+ * merges the cores' sketches: counts are overestimates by at most error_.
+ *
+ * Tables are opaque handles (the underlying btree), named through
+ * register_table(). Keys longer than MaxKeyLength are truncated
+ */
+class conflict_sampler {
+public:
+
+  static const size_t K = 32;              // slots in each core's sketch
+  static const size_t MaxKeyLength = 64;
+
+  // set before any worker starts. txns only remember the keys they read
+  // while this is set, see transaction::note_read_key()
+  static bool g_enabled;
+
+  struct entry {
+    std::string table_;
+    std::string key_;     // possibly truncated
+    uint64_t count_;
+    uint64_t error_;      // count_ - error_ is a lower bound
+  };
+
+  static void register_table(const void *table, const std::string &name);
+  static void unregister_table(const void *table);
+
+  static inline ALWAYS_INLINE void
+  offer(const void *table, const std::string &key)
+  {
+    if (likely(!g_enabled))
+      return;
+    offer_slow(table, key.data(), key.size());
+  }
+
+  // the conflict could not be traced back to a key
+  static inline ALWAYS_INLINE void
+  offer_unattributed()
+  {
+    if (likely(!g_enabled))
+      return;
+    ++g_evt_unattributed;
+  }
+
+  // the n most conflicted keys, per table name. expensive
+  static std::map<std::string, std::vector<entry>> top(size_t n = K);
+
+  static void reset();
+
+private:
+
+  struct slot {
+    const void *table_;
+    uint64_t count_;
+    uint64_t error_;
+    uint32_t keylen_;
+    char key_[MaxKeyLength];
+  };
+
+  struct sketch {
+    sketch() : slots_(nullptr), nused_(0) {}
+    spinlock lock_; // only contended by readers
+    slot *slots_;
+    size_t nused_;
+  };
+
+  static void offer_slow(const void *table, const char *key, size_t keylen);
+
+  static percore<sketch> g_sketches CACHE_ALIGNED;
+  static event_counter g_evt_samples;
+  static event_counter g_evt_unattributed;
+};
+
+#endif /* _NDB_CONFLICT_SAMPLER_H_ */
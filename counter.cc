@@ -23,9 +23,18 @@ event_ctx::event_counters_lock()
 void
 event_ctx::stat(counter_data &d)
 {
+  if (tag_ == TAG_HIST) {
+    event_ctx_hist::histogram_type h;
+    static_cast<event_ctx_hist *>(this)->snapshot(h);
+    d.type_ = counter_data::TYPE_AGG;
+    d.count_ += h.count();
+    d.sum_ = h.sum();
+    d.max_ = h.max();
+    return;
+  }
   for (size_t i = 0; i < coreid::NMaxCores; i++)
     d.count_ += counts_[i];
-  if (avg_tag_) {
+  if (tag_ == TAG_AVG) {
     d.type_ = counter_data::TYPE_AGG;
     uint64_t m = 0;
     for (size_t i = 0; i < coreid::NMaxCores; i++) {
@@ -39,6 +48,13 @@ event_ctx::stat(counter_data &d)
   }
 }
 
+void
+event_ctx_hist::snapshot(histogram_type &h)
+{
+  for (size_t i = 0; i < coreid::NMaxCores; i++)
+    h.merge(hists_[i]);
+}
+
 map<string, counter_data>
 event_counter::get_all_counters()
 {
@@ -65,9 +81,11 @@ event_counter::reset_all_counters()
   for (auto &p : evts)
     for (size_t i = 0; i < coreid::NMaxCores; i++) {
       p.second->counts_[i] = 0;
-      if (p.second->avg_tag_) {
+      if (p.second->tag_ == event_ctx::TAG_AVG) {
         static_cast<event_ctx_avg *>(p.second)->sums_[i] = 0;
         static_cast<event_ctx_avg *>(p.second)->highs_[i] = 0;
+      } else if (p.second->tag_ == event_ctx::TAG_HIST) {
+        static_cast<event_ctx_hist *>(p.second)->hists_[i].clear();
       }
     }
 }
@@ -90,9 +108,40 @@ event_counter::stat(const string &name, counter_data &d)
   return true;
 }
 
+bool
+event_hist_counter::stat_hist(const string &name, histogram_type &h)
+{
+  const map<string, event_ctx *> &evts = event_ctx::event_counters();
+  spinlock &l = event_ctx::event_counters_lock();
+  event_ctx *ctx = nullptr;
+  {
+    lock_guard<spinlock> sl(l);
+    auto it = evts.find(name);
+    if (it != evts.end())
+      ctx = it->second;
+  }
+  if (!ctx || ctx->tag_ != event_ctx::TAG_HIST)
+    return false;
+  static_cast<event_ctx_hist *>(ctx)->snapshot(h);
+  return true;
+}
+
+map<string, event_hist_counter::histogram_type>
+event_hist_counter::get_all_histograms()
+{
+  map<string, histogram_type> ret;
+  const map<string, event_ctx *> &evts = event_ctx::event_counters();
+  spinlock &l = event_ctx::event_counters_lock();
+  lock_guard<spinlock> sl(l);
+  for (auto &p : evts)
+    if (p.second->tag_ == event_ctx::TAG_HIST)
+      static_cast<event_ctx_hist *>(p.second)->snapshot(ret[p.first]);
+  return ret;
+}
+
 #ifdef ENABLE_EVENT_COUNTERS
 event_counter::event_counter(const string &name)
-  : ctx_(name, false)
+  : ctx_(name, event_ctx::TAG_COUNT)
 {
   spinlock &l = event_ctx::event_counters_lock();
   map<string, event_ctx *> &evts = event_ctx::event_counters();
@@ -108,6 +157,15 @@ event_avg_counter::event_avg_counter(const string &name)
   lock_guard<spinlock> sl(l);
   evts[name] = ctx_.obj();
 }
+
+event_hist_counter::event_hist_counter(const string &name)
+  : ctx_(name)
+{
+  spinlock &l = event_ctx::event_counters_lock();
+  map<string, event_ctx *> &evts = event_ctx::event_counters();
+  lock_guard<spinlock> sl(l);
+  evts[name] = ctx_.obj();
+}
 #else
 event_counter::event_counter(const string &name)
 {
@@ -116,4 +174,8 @@ event_counter::event_counter(const string &name)
 event_avg_counter::event_avg_counter(const string &name)
 {
 }
+
+event_hist_counter::event_hist_counter(const string &name)
+{
+}
 #endif
@@ -13,6 +13,7 @@
 #include "core.h"
 #include "util.h"
 #include "spinlock.h"
+#include "histogram.h"
 
 struct counter_data {
   enum Type { TYPE_COUNT, TYPE_AGG };
@@ -52,8 +53,10 @@ namespace private_ {
     static spinlock &event_counters_lock();
 
     // tag to avoid making event_ctx virtual
-    event_ctx(const std::string &name, bool avg_tag)
-      : name_(name), avg_tag_(avg_tag)
+    enum tag { TAG_COUNT, TAG_AVG, TAG_HIST };
+
+    event_ctx(const std::string &name, tag t)
+      : name_(name), tag_(t)
     {}
 
     ~event_ctx()
@@ -68,7 +71,7 @@ namespace private_ {
     void stat(counter_data &d);
 
     const std::string name_;
-    const bool avg_tag_;
+    const tag tag_;
 
     // per-thread counts
     percore<uint64_t, false, false> counts_;
@@ -76,10 +79,19 @@ namespace private_ {
 
   // more expensive
   struct event_ctx_avg : public event_ctx {
-    event_ctx_avg(const std::string &name) : event_ctx(name, true) {}
+    event_ctx_avg(const std::string &name) : event_ctx(name, TAG_AVG) {}
     percore<uint64_t, false, false> sums_;
     percore<uint64_t, false, false> highs_;
   };
+
+  // much more expensive (~2KB per core). counts_ is unused, the
+  // histograms keep their own
+  struct event_ctx_hist : public event_ctx {
+    typedef basic_log_linear_histogram<2> histogram_type;
+    event_ctx_hist(const std::string &name) : event_ctx(name, TAG_HIST) {}
+    void snapshot(histogram_type &h);
+    percore<histogram_type, false, false> hists_;
+  };
 }
 
 class event_counter {
@@ -150,6 +162,44 @@ private:
 #endif
 };
 
+/**
+ * Like event_avg_counter, but also keeps the distribution of the offered
+ * values, in power of two buckets split in four- percentiles are within
+ * 25% of the true value. Shows up as a TYPE_AGG counter everywhere
+ * counters are listed, and stat_hist() gets the whole distribution
+ */
+class event_hist_counter {
+public:
+  typedef private_::event_ctx_hist::histogram_type histogram_type;
+
+  event_hist_counter(const std::string &name);
+
+  event_hist_counter(const event_hist_counter &) = delete;
+  event_hist_counter &operator=(const event_hist_counter &) = delete;
+  event_hist_counter(event_hist_counter &&) = delete;
+
+  inline ALWAYS_INLINE void
+  offer(uint64_t value)
+  {
+#ifdef ENABLE_EVENT_COUNTERS
+    ctx_->hists_.my().record(value);
+#endif
+  }
+
+  // the per core histograms merged- racy w/ concurrent offer()-s
+  //
+  // WARNING: an expensive operation!
+  static bool
+  stat_hist(const std::string &name, histogram_type &h);
+  // WARNING: an expensive operation!
+  static std::map<std::string, histogram_type> get_all_histograms();
+
+private:
+#ifdef ENABLE_EVENT_COUNTERS
+  unmanaged<private_::event_ctx_hist> ctx_;
+#endif
+};
+
 inline std::ostream &
 operator<<(std::ostream &o, const counter_data &d)
 {
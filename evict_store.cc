@@ -0,0 +1,66 @@
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "evict_store.h"
+
+using namespace std;
+
+evict_store evict_store::s_instance;
+
+event_counter evict_store::g_evt_evict_store_bytes_written("evict_store_bytes_written");
+event_counter evict_store::g_evt_evict_store_bytes_read("evict_store_bytes_read");
+
+evict_store::~evict_store()
+{
+  if (fd_ != -1)
+    close(fd_);
+}
+
+void
+evict_store::open(const string &path)
+{
+  ALWAYS_ASSERT(fd_ == -1);
+  const int fd = ::open(path.c_str(), O_CREAT|O_RDWR|O_TRUNC, 0664);
+  if (fd == -1) {
+    perror("open");
+    ALWAYS_ASSERT(false);
+  }
+  fd_ = fd;
+}
+
+uint64_t
+evict_store::append(const uint8_t *p, size_t n)
+{
+  INVARIANT(is_open());
+  // reserve our range first, so appenders never serialize on the file
+  const uint64_t off = tail_.fetch_add(n, memory_order_acq_rel);
+  size_t done = 0;
+  while (done < n) {
+    const ssize_t ret = pwrite(fd_, p + done, n - done, off + done);
+    if (unlikely(ret == -1)) {
+      perror("pwrite");
+      ALWAYS_ASSERT(false);
+    }
+    done += ret;
+  }
+  g_evt_evict_store_bytes_written += n;
+  return off;
+}
+
+void
+evict_store::read(uint64_t off, uint8_t *p, size_t n) const
+{
+  INVARIANT(is_open());
+  INVARIANT(off + n <= size());
+  size_t done = 0;
+  while (done < n) {
+    const ssize_t ret = pread(fd_, p + done, n - done, off + done);
+    if (unlikely(ret <= 0)) {
+      perror("pread");
+      ALWAYS_ASSERT(false);
+    }
+    done += ret;
+  }
+  g_evt_evict_store_bytes_read += n;
+}
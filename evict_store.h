@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <string>
+
+#include "macros.h"
+#include "counter.h"
+
+/**
+ * Append-only local file which holds the values of evicted (anti-cached)
+ * tuples. The tree keeps a small stub per evicted tuple recording the
+ * offset of its value in here.
+ *
+ * Space is never reclaimed- faulting a record back in just leaves a hole
+ * behind (XXX: garbage collect the file)
+ */
+class evict_store {
+public:
+
+  evict_store() : fd_(-1), tail_(0) {}
+  ~evict_store();
+
+  evict_store(const evict_store &) = delete;
+  evict_store(evict_store &&) = delete;
+  evict_store &operator=(const evict_store &) = delete;
+
+  // truncates path. not threadsafe- must be called before any evictions
+  void open(const std::string &path);
+
+  inline bool
+  is_open() const
+  {
+    return fd_ != -1;
+  }
+
+  // bytes appended so far (including holes)
+  inline uint64_t
+  size() const
+  {
+    return tail_.load(std::memory_order_acquire);
+  }
+
+  // appends [p, p + n), returning the offset to later read() it back from.
+  // threadsafe
+  uint64_t append(const uint8_t *p, size_t n);
+
+  // reads n bytes at off into p. threadsafe
+  void read(uint64_t off, uint8_t *p, size_t n) const;
+
+  static evict_store s_instance;
+
+private:
+  int fd_;
+  std::atomic<uint64_t> tail_;
+
+  static event_counter g_evt_evict_store_bytes_written;
+  static event_counter g_evt_evict_store_bytes_read;
+};
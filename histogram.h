@@ -0,0 +1,132 @@
+#ifndef _NDB_HISTOGRAM_H_
+#define _NDB_HISTOGRAM_H_
+
+#include <algorithm>
+#include <cstring>
+#include <ostream>
+#include <stdint.h>
+
+#include "macros.h"
+
+/**
+ * HDR-style log-linear histogram over uint64_t values (ie latencies in us):
+ * values below 2*SubBuckets land in their own bucket, and every power of two
+ * above that is split into SubBuckets equal buckets- so any recorded value
+ * is reported to within 1/SubBuckets of itself, in constant space.
+ *
+ * Not thread-safe: meant to have a single writer (one per worker thread),
+ * with the per-thread histograms merge()-ed once they are done
+ */
+template <unsigned SubBucketBitsT>
+class basic_log_linear_histogram {
+public:
+
+  static const unsigned SubBucketBits = SubBucketBitsT;
+  static const uint64_t SubBuckets = 1UL << SubBucketBits;
+  static const size_t NBuckets = (65 - SubBucketBits) * SubBuckets;
+
+  basic_log_linear_histogram()
+  {
+    clear();
+  }
+
+  inline void
+  record(uint64_t v)
+  {
+    buckets_[bucket_of(v)]++;
+    count_++;
+    sum_ += v;
+    max_ = std::max(max_, v);
+  }
+
+  void
+  merge(const basic_log_linear_histogram &that)
+  {
+    for (size_t i = 0; i < NBuckets; i++)
+      buckets_[i] += that.buckets_[i];
+    count_ += that.count_;
+    sum_ += that.sum_;
+    max_ = std::max(max_, that.max_);
+  }
+
+  void
+  clear()
+  {
+    NDB_MEMSET(&buckets_[0], 0, sizeof(buckets_));
+    count_ = sum_ = max_ = 0;
+  }
+
+  inline uint64_t count() const { return count_; }
+  inline uint64_t sum() const { return sum_; }
+  inline uint64_t max() const { return max_; }
+
+  inline double
+  mean() const
+  {
+    return count_ ? double(sum_) / double(count_) : 0.0;
+  }
+
+  // smallest v such that at least p percent (0 <= p <= 100) of the
+  // recorded values are <= v, give or take the bucket width
+  uint64_t
+  percentile(double p) const
+  {
+    if (!count_)
+      return 0;
+    uint64_t want = uint64_t(double(count_) * p / 100.0 + 0.5);
+    if (!want)
+      want = 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < NBuckets; i++) {
+      seen += buckets_[i];
+      if (seen >= want)
+        // the max is exact, and may fall inside the bucket
+        return std::min(bucket_upper(i), max_);
+    }
+    return max_;
+  }
+
+  // "p50=... p90=... p99=... p99.9=... max=..."
+  void
+  print_percentiles(std::ostream &o) const
+  {
+    o << "p50=" << percentile(50.0)
+      << " p90=" << percentile(90.0)
+      << " p99=" << percentile(99.0)
+      << " p99.9=" << percentile(99.9)
+      << " max=" << max_;
+  }
+
+  static inline size_t
+  bucket_of(uint64_t v)
+  {
+    if (v < 2 * SubBuckets)
+      return v;
+    const unsigned shift = (63 - __builtin_clzl(v)) - SubBucketBits;
+    // (v >> shift) is in [SubBuckets, 2*SubBuckets)
+    return shift * SubBuckets + (v >> shift);
+  }
+
+  // the largest value which maps to bucket i
+  static inline uint64_t
+  bucket_upper(size_t i)
+  {
+    INVARIANT(i < NBuckets);
+    if (i < 2 * SubBuckets)
+      return i;
+    const unsigned shift = i / SubBuckets - 1;
+    const uint64_t m = i - shift * SubBuckets;
+    return ((m + 1) << shift) - 1;
+  }
+
+private:
+  uint64_t buckets_[NBuckets];
+  uint64_t count_;
+  uint64_t sum_;
+  uint64_t max_;
+};
+
+// values within 1/64 of themselves, in ~30KB
+typedef basic_log_linear_histogram<6> log_linear_histogram;
+
+#endif /* _NDB_HISTOGRAM_H_ */
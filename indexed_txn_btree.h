@@ -0,0 +1,188 @@
+#ifndef _NDB_INDEXED_TXN_BTREE_H_
+#define _NDB_INDEXED_TXN_BTREE_H_
+
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+
+#include "typed_txn_btree.h"
+
+/**
+ * A secondary index over the records of a typed_txn_btree<Transaction,
+ * Schema>, itself a typed_txn_btree over IndexSchema (declared w/
+ * DO_STRUCT(), like any other schema). Extractor is a stateless functor:
+ *
+ *   bool operator()(const Schema::key_type &, const Schema::value_type &,
+ *                   IndexSchema::key_type &, IndexSchema::value_type &) const
+ *
+ * which fills in the index entry for a record, or returns false if the
+ * record is not indexed. Index keys must be unique- append the primary key
+ * fields if the indexed ones are not. The index value may just repeat the
+ * primary key, or carry copies of whatever record fields a read path needs,
+ * in which case that path can be answered from the index alone (a covering
+ * index).
+ *
+ * Entries are only maintained by an indexed_txn_btree this index is
+ * attached to- writing to the index directly is allowed, but then keeping
+ * it in sync is up to the caller
+ */
+template <template <typename> class Transaction,
+          typename Schema, typename IndexSchema, typename Extractor>
+class typed_secondary_index : public typed_txn_btree<Transaction, IndexSchema> {
+  typedef typed_txn_btree<Transaction, IndexSchema> super_type;
+public:
+
+  typedef typename super_type::size_type size_type;
+  typedef typename Schema::key_type record_key_type;
+  typedef typename Schema::value_type record_value_type;
+  typedef typename IndexSchema::key_type key_type;
+  typedef typename IndexSchema::value_type value_type;
+
+  typed_secondary_index(size_type value_size_hint = 128,
+                        bool mostly_append = false,
+                        const std::string &name = "<unknown>")
+    : super_type(value_size_hint, mostly_append, name)
+  {}
+
+  // moves the entry for record k from what old_v maps to (if anything) to
+  // what new_v maps to (if anything). either may be null (insert/delete)
+  template <typename Traits>
+  void
+  maintain(Transaction<Traits> &t,
+           const record_key_type &k,
+           const record_value_type *old_v,
+           const record_value_type *new_v)
+  {
+    Extractor extract;
+    key_type old_ik, new_ik;
+    value_type old_iv, new_iv;
+    const bool had_old = old_v && extract(k, *old_v, old_ik, old_iv);
+    const bool has_new = new_v && extract(k, *new_v, new_ik, new_iv);
+    if (had_old && (!has_new || old_ik != new_ik))
+      this->remove(t, old_ik);
+    if (!has_new)
+      return;
+    if (!had_old || old_ik != new_ik)
+      this->insert(t, new_ik, new_iv);
+    else if (old_iv != new_iv)
+      // only the covered fields changed
+      this->put(t, new_ik, new_iv);
+  }
+};
+
+/**
+ * A typed_txn_btree which keeps a set of typed_secondary_index-es in sync
+ * with its records. put(), insert() and remove() add the matching index
+ * writes to the same txn, so they become visible atomically at commit (and
+ * abort along with it). To know which entries to move, all three first
+ * read the record- unlike on a plain typed_txn_btree, these always add the
+ * record to the txn's read set (an insert() over an existing key overwrites
+ * it, and its old entries have to go).
+ *
+ * The indexes are owned by this tree, see index<I>()
+ */
+template <template <typename> class Transaction, typename Schema,
+          typename... Indexes>
+class indexed_txn_btree : public typed_txn_btree<Transaction, Schema> {
+  typedef typed_txn_btree<Transaction, Schema> super_type;
+  typedef std::tuple<Indexes...> index_tuple;
+public:
+
+  typedef typename super_type::size_type size_type;
+  typedef typename super_type::key_type key_type;
+  typedef typename super_type::value_type value_type;
+  typedef typename super_type::value_descriptor_type value_descriptor_type;
+  typedef typename super_type::AllFields AllFields;
+
+  indexed_txn_btree(size_type value_size_hint = 128,
+                    bool mostly_append = false,
+                    const std::string &name = "<unknown>")
+    : super_type(value_size_hint, mostly_append, name)
+  {}
+
+  template <size_t I>
+  inline typename std::tuple_element<I, index_tuple>::type &
+  index()
+  {
+    return std::get<I>(indexes);
+  }
+
+  template <size_t I>
+  inline const typename std::tuple_element<I, index_tuple>::type &
+  index() const
+  {
+    return std::get<I>(indexes);
+  }
+
+  template <typename Traits, typename FieldsMask = AllFields>
+  inline void
+  put(Transaction<Traits> &t, const key_type &k, const value_type &v,
+      FieldsMask fm = FieldsMask())
+  {
+    value_type old_v;
+    const bool had = super_type::search(t, k, old_v);
+    // a partial put only makes sense for an existing record- otherwise the
+    // unmasked fields (and the index entries built from them) are garbage
+    ALWAYS_ASSERT(had || super_type::AllFieldsMask == FieldsMask::value);
+    super_type::put(t, k, v, fm);
+    if (super_type::AllFieldsMask == FieldsMask::value) {
+      maintain_all<0>(t, k, had ? &old_v : nullptr, &v);
+      return;
+    }
+    // the new record is the old one w/ the fields in the mask swapped in
+    value_type new_v = old_v;
+    for (size_t i = 0; i < value_descriptor_type::nfields(); i++) {
+      if (!((1UL << i) & FieldsMask::value))
+        continue;
+      const size_t off = value_descriptor_type::cstruct_offsetof(i);
+      memcpy(reinterpret_cast<uint8_t *>(&new_v) + off,
+             reinterpret_cast<const uint8_t *>(&v) + off,
+             value_descriptor_type::cstruct_sizeof(i));
+    }
+    maintain_all<0>(t, k, &old_v, &new_v);
+  }
+
+  template <typename Traits>
+  inline void
+  insert(Transaction<Traits> &t, const key_type &k, const value_type &v)
+  {
+    value_type old_v;
+    const bool had = super_type::search(t, k, old_v);
+    super_type::insert(t, k, v);
+    maintain_all<0>(t, k, had ? &old_v : nullptr, &v);
+  }
+
+  template <typename Traits>
+  inline void
+  remove(Transaction<Traits> &t, const key_type &k)
+  {
+    value_type old_v;
+    if (!super_type::search(t, k, old_v))
+      // nothing to remove from the indexes either
+      return;
+    super_type::remove(t, k);
+    maintain_all<0>(t, k, &old_v, nullptr);
+  }
+
+private:
+
+  template <size_t I, typename Traits>
+  inline typename std::enable_if<(I < sizeof...(Indexes))>::type
+  maintain_all(Transaction<Traits> &t, const key_type &k,
+               const value_type *old_v, const value_type *new_v)
+  {
+    std::get<I>(indexes).maintain(t, k, old_v, new_v);
+    maintain_all<I + 1>(t, k, old_v, new_v);
+  }
+
+  template <size_t I, typename Traits>
+  inline typename std::enable_if<(I == sizeof...(Indexes))>::type
+  maintain_all(Transaction<Traits> &t, const key_type &k,
+               const value_type *old_v, const value_type *new_v)
+  {
+  }
+
+  index_tuple indexes;
+};
+
+#endif /* _NDB_INDEXED_TXN_BTREE_H_ */
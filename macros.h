@@ -27,6 +27,13 @@
 #define PROTO2_CAN_DISABLE_GC
 #define PROTO2_CAN_DISABLE_SNAPSHOTS
 //#define USE_PERF_CTRS
+//#define TUPLE_COLD_COMPRESSION
+//#define TUPLE_ANTI_CACHING
+
+// both of the above pick cold tuples by per-tuple read recency
+#if defined(TUPLE_COLD_COMPRESSION) || defined(TUPLE_ANTI_CACHING)
+#define TUPLE_TRACK_ACCESS
+#endif
 
 #ifndef CONFIG_H
 #error "no CONFIG_H set"
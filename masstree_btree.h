@@ -13,6 +13,8 @@
 #include <vector>
 #include <utility>
 #include <atomic>
+#include <memory>
+#include <algorithm>
 
 #include "log2.hh"
 #include "varkey.h"
@@ -23,6 +25,7 @@
 #include "rcu.h"
 #include "util.h"
 #include "ownership_checker.h"
+#include "point_index.h"
 
 #include "masstree/masstree_scan.hh"
 #include "masstree/masstree_insert.hh"
@@ -237,6 +240,7 @@ public:
     rcu_region guard;
     threadinfo ti;
     table_.destroy(ti);
+    disable_leaf_cache();
   }
 
   /**
@@ -247,15 +251,85 @@ public:
     threadinfo ti;
     table_.destroy(ti);
     table_.initialize(ti);
+    reset_size_estimate(0);
+    if (point_index_)
+      point_index_->clear();
+    reset_leaf_cache();
   }
 
+  /**
+   * NOT THREAD SAFE. Keeps a hash index of all keys next to the tree,
+   * which search() tries first (see point_index). Worth it for tables
+   * which are only point accessed, and whose keys are rarely inserted or
+   * removed- every insert/remove updates both
+   */
+  inline void enable_point_index() {
+    if (point_index_)
+      return;
+    point_index_.reset(new point_index<value_type>);
+    fill_point_index();
+  }
+
+  inline bool has_point_index() const {
+    return bool(point_index_);
+  }
+
+  /**
+   * NOT THREAD SAFE. Gives each core a small cache of where (leaf, slot)
+   * it last found a key, which search() checks before descending the
+   * tree. A cached leaf is only trusted if its version is unchanged since
+   * (and the RCU tick it was cached in cannot have been reclaimed yet), so
+   * entries go stale as soon as their leaf is modified. Pays off for
+   * skewed point lookups of keys of up to LeafCacheMaxKeyLen bytes
+   */
+  void enable_leaf_cache();
+  void disable_leaf_cache();
+
+  inline bool has_leaf_cache() const {
+    return bool(leaf_cache_);
+  }
+
+  // lookups answered (hits) and not answered (misses) by the leaf cache,
+  // summed over all cores. Not threadsafe
+  void leaf_cache_stats(uint64_t &hits, uint64_t &misses) const;
+
   /** Note: invariant checking is not thread safe */
   inline void invariant_checker() const {
   }
 
+  /**
+   * The root of the tree, for handing to unsafe_reattach() in a later
+   * process which has remapped the same memory (see allocator::Shutdown())
+   */
+  inline const void *unsafe_root() const {
+    return table_.root();
+  }
+
+  /**
+   * NOT THREAD SAFE. Throws away this (empty) tree and adopts the one
+   * rooted at root
+   */
+  inline void unsafe_reattach(const void *root) {
+    // XXX: basic_table has no root setter- but a table is nothing but
+    // its root pointer
+    static_assert(sizeof(table_) == sizeof(node_base_type *),
+                  "basic_table layout changed");
+    {
+      rcu_region guard;
+      threadinfo ti;
+      table_.destroy(ti);
+    }
+    NDB_MEMCPY(&table_, &root, sizeof(root));
+    reset_size_estimate(size());
+    if (point_index_)
+      fill_point_index();
+    reset_leaf_cache();
+  }
+
           /** NOTE: the public interface assumes that the caller has taken care
            * of setting up RCU */
 
+  // search_info is only filled in when k is not found
   inline bool search(const key_type &k, value_type &v,
                      versioned_node_t *search_info = nullptr) const;
 
@@ -443,6 +517,24 @@ public:
    */
   inline size_t size() const;
 
+  /**
+   * Returns at least nsamples sorted keys (unless the tree is too small to
+   * have that many) which cut the tree into roughly equal parts. They are
+   * the separators of the shallowest level of interior nodes with enough
+   * of them, so no leaf is ever visited.
+   *
+   * XXX: only the first layer is sampled, so keys which share their first
+   * 8 bytes are never split apart
+   */
+  std::vector<std::string> sample_separators(size_t nsamples) const;
+
+  /**
+   * The number of keys, from per-core deltas kept by insert() and remove()
+   * and only summed up here. Cheap, and exact whenever the tree is
+   * quiescent- size() is the exact (but O(n)) alternative
+   */
+  inline size_t size_estimate() const;
+
   static inline uint64_t
   ExtractVersionNumber(const node_opaque_t *n) {
     // XXX(stephentu): I think we must use stable_version() for
@@ -473,6 +565,47 @@ public:
 
  private:
   Masstree::basic_table<P> table_;
+  percore<int64_t, false, false> size_deltas_; // see size_estimate()
+  std::unique_ptr<point_index<value_type>> point_index_; // nullptr if disabled
+
+  static const size_t LeafCacheSize = 64; // entries per core, power of two
+  static const size_t LeafCacheMaxKeyLen = 16;
+  struct leaf_cache_entry {
+    const leaf_type *leaf; // nullptr if empty
+    uint64_t version;      // leaf's full version when cached
+    uint64_t rcu_tick;     // rcu tick of the region it was cached in
+    int slot;
+    uint8_t keylen;
+    char key[LeafCacheMaxKeyLen];
+  };
+  struct leaf_cache_core {
+    uint64_t hits;
+    uint64_t misses;
+    leaf_cache_entry entries[LeafCacheSize];
+  };
+  // each core's block is allocated by that core, on first use
+  std::unique_ptr<percore<leaf_cache_core *, false, false>> leaf_cache_;
+
+  inline leaf_cache_core &leaf_cache_my() const;
+  inline leaf_cache_entry &leaf_cache_slot(leaf_cache_core &c,
+                                           const key_type &k) const;
+  inline bool leaf_cache_probe(const leaf_cache_entry &e, const key_type &k,
+                               value_type &v) const;
+  inline bool leaf_cache_search(const key_type &k, value_type &v) const;
+  inline void leaf_cache_fill(const key_type &k, const leaf_type *n,
+                              uint64_t version, value_type v) const;
+  // NOT THREAD SAFE
+  void reset_leaf_cache();
+
+  // NOT THREAD SAFE
+  inline void reset_size_estimate(size_t n) {
+    for (size_t i = 0; i < size_deltas_.size(); i++)
+      size_deltas_[i] = 0;
+    size_deltas_[0] = n;
+  }
+
+  // NOT THREAD SAFE
+  void fill_point_index();
 
   static leaf_type* leftmost_descend_layer(node_base_type* n);
   class size_walk_callback;
@@ -481,6 +614,20 @@ public:
   template <typename F> class low_level_search_range_callback_wrapper;
 };
 
+template <typename P>
+void
+mbtree<P>::fill_point_index()
+{
+  // point_index frees through RCU
+  scoped_rcu_region guard;
+  point_index_->clear();
+  auto fn = [this](const string_type &k, value_type v) {
+    point_index_->put(k.data(), k.length(), v);
+    return true;
+  };
+  search_range(key_type(), nullptr, fn);
+}
+
 template <typename P>
 typename mbtree<P>::leaf_type *
 mbtree<P>::leftmost_descend_layer(node_base_type *n)
@@ -580,21 +727,229 @@ inline size_t mbtree<P>::size() const
   return c.size_;
 }
 
+template <typename P>
+std::vector<std::string>
+mbtree<P>::sample_separators(size_t nsamples) const
+{
+  rcu_region guard;
+  // root_ is not updated on a root split, the real root is above it
+  node_base_type *root = table_.root();
+  while (!root->is_root())
+    root = root->maybe_parent();
+  std::vector<uint64_t> seps;
+  std::vector<node_base_type *> level(1, root);
+  while (seps.size() < nsamples) {
+    std::vector<uint64_t> lseps;
+    std::vector<node_base_type *> next;
+    for (node_base_type *cur : level) {
+      if (cur->isleaf())
+        continue;
+      internode_type *in = static_cast<internode_type *>(cur);
+    retry:
+      const size_t nlseps = lseps.size(), nnext = next.size();
+      nodeversion_type version = in->stable();
+      const int nkeys = in->size();
+      for (int i = 0; i < nkeys; i++)
+        lseps.push_back(in->ikey0_[i]);
+      for (int i = 0; i <= nkeys; i++)
+        next.push_back(in->child_[i]);
+      if (unlikely(in->has_changed(version))) {
+        lseps.resize(nlseps);
+        next.resize(nnext);
+        goto retry;
+      }
+    }
+    if (lseps.empty())
+      // hit the leaves
+      break;
+    seps.swap(lseps);
+    level.swap(next);
+  }
+  // concurrent splits can leave a level slightly out of order
+  std::sort(seps.begin(), seps.end());
+  seps.erase(std::unique(seps.begin(), seps.end()), seps.end());
+  std::vector<std::string> ret;
+  ret.reserve(seps.size());
+  for (uint64_t s : seps) {
+    // ikeys compare like the big-endian slices they came from
+    std::string k(sizeof(s), 0);
+    for (size_t i = 0; i < sizeof(s); i++)
+      k[i] = char(s >> (8 * (sizeof(s) - 1 - i)));
+    ret.emplace_back(std::move(k));
+  }
+  return ret;
+}
+
+template <typename P>
+inline size_t mbtree<P>::size_estimate() const
+{
+  int64_t n = 0;
+  for (size_t i = 0; i < size_deltas_.size(); i++)
+    n += size_deltas_[i];
+  // a remove can be counted before the insert it undoes
+  return n > 0 ? n : 0;
+}
+
 template <typename P>
 inline bool mbtree<P>::search(const key_type &k, value_type &v,
                               versioned_node_t *search_info) const
 {
   rcu_region guard;
+  if (point_index_ &&
+      point_index_->search((const char *) k.data(), k.length(), v))
+    return true;
+  if (leaf_cache_ && leaf_cache_search(k, v))
+    return true;
   threadinfo ti;
   Masstree::unlocked_tcursor<P> lp(table_, k.data(), k.length());
   bool found = lp.find_unlocked(ti);
-  if (found)
+  if (found) {
     v = lp.value();
+    if (leaf_cache_)
+      leaf_cache_fill(k, lp.node(), lp.full_version_value(), v);
+  }
   if (search_info)
     *search_info = versioned_node_t(lp.node(), lp.full_version_value());
   return found;
 }
 
+template <typename P>
+inline typename mbtree<P>::leaf_cache_core &
+mbtree<P>::leaf_cache_my() const
+{
+  leaf_cache_core *&c = leaf_cache_->my();
+  if (unlikely(!c))
+    c = (leaf_cache_core *) calloc(1, sizeof(leaf_cache_core));
+  return *c;
+}
+
+template <typename P>
+inline typename mbtree<P>::leaf_cache_entry &
+mbtree<P>::leaf_cache_slot(leaf_cache_core &c, const key_type &k) const
+{
+  const uint32_t h = XXH32(k.data(), k.length(), 0);
+  return c.entries[h & (LeafCacheSize - 1)];
+}
+
+template <typename P>
+inline bool mbtree<P>::leaf_cache_search(const key_type &k, value_type &v) const
+{
+  leaf_cache_core &c = leaf_cache_my();
+  if (k.length() <= LeafCacheMaxKeyLen &&
+      leaf_cache_probe(leaf_cache_slot(c, k), k, v)) {
+    c.hits++;
+    return true;
+  }
+  c.misses++;
+  return false;
+}
+
+template <typename P>
+inline bool mbtree<P>::leaf_cache_probe(const leaf_cache_entry &e,
+                                        const key_type &k,
+                                        value_type &v) const
+{
+  if (!e.leaf ||
+      e.keylen != k.length() ||
+      memcmp(e.key, k.data(), k.length()))
+    return false;
+  // the leaf might have been reclaimed since if it was unlinked in (or
+  // after) e.rcu_tick, unless that tick is still being held back
+  if (rcu::s_instance.cleaning_rcu_tick_exclusive() > e.rcu_tick)
+    return false;
+  const leaf_type *n = e.leaf;
+  const uint64_t v0 = n->full_version_value();
+  if (v0 != e.version)
+    return false;
+  COMPILER_MEMORY_FENCE;
+  // the slot could have been removed without a version change, but not
+  // reused by another key
+  auto perm = n->permutation();
+  bool live = false;
+  for (int i = 0; i != perm.size() && !live; ++i)
+    live = perm[i] == e.slot;
+  if (!live || n->is_layer(e.slot))
+    return false;
+  const value_type ret = n->lv_[e.slot].value();
+  COMPILER_MEMORY_FENCE;
+  if (n->full_version_value() != v0)
+    return false;
+  // like a seqlock: the leaf must not have become reclaimable while we
+  // were reading it either, or what we read may be garbage
+  COMPILER_MEMORY_FENCE;
+  if (rcu::s_instance.cleaning_rcu_tick_exclusive() > e.rcu_tick)
+    return false;
+  v = ret;
+  return true;
+}
+
+template <typename P>
+inline void mbtree<P>::leaf_cache_fill(const key_type &k, const leaf_type *n,
+                                       uint64_t version, value_type v) const
+{
+  if (k.length() > LeafCacheMaxKeyLen)
+    return;
+  uint64_t rcu_tick;
+  if (!rcu::s_instance.in_rcu_region(rcu_tick))
+    return;
+  // values are tuple pointers, so unique within the leaf
+  auto perm = n->permutation();
+  int slot = -1;
+  for (int i = 0; i != perm.size() && slot == -1; ++i)
+    if (!n->is_layer(perm[i]) && n->lv_[perm[i]].value() == v)
+      slot = perm[i];
+  COMPILER_MEMORY_FENCE;
+  if (slot == -1 || n->full_version_value() != version)
+    return;
+  leaf_cache_entry &e = leaf_cache_slot(leaf_cache_my(), k);
+  e.leaf = n;
+  e.version = version;
+  e.rcu_tick = rcu_tick;
+  e.slot = slot;
+  e.keylen = k.length();
+  NDB_MEMCPY(e.key, k.data(), k.length());
+}
+
+template <typename P>
+void mbtree<P>::enable_leaf_cache()
+{
+  if (!leaf_cache_)
+    leaf_cache_.reset(new percore<leaf_cache_core *, false, false>);
+}
+
+template <typename P>
+void mbtree<P>::disable_leaf_cache()
+{
+  if (!leaf_cache_)
+    return;
+  for (size_t i = 0; i < leaf_cache_->size(); i++)
+    free((*leaf_cache_)[i]);
+  leaf_cache_.reset();
+}
+
+template <typename P>
+void mbtree<P>::reset_leaf_cache()
+{
+  if (!leaf_cache_)
+    return;
+  for (size_t i = 0; i < leaf_cache_->size(); i++)
+    if ((*leaf_cache_)[i])
+      NDB_MEMSET((*leaf_cache_)[i], 0, sizeof(leaf_cache_core));
+}
+
+template <typename P>
+void mbtree<P>::leaf_cache_stats(uint64_t &hits, uint64_t &misses) const
+{
+  hits = misses = 0;
+  if (!leaf_cache_)
+    return;
+  for (size_t i = 0; i < leaf_cache_->size(); i++)
+    if ((*leaf_cache_)[i]) {
+      hits += (*leaf_cache_)[i]->hits;
+      misses += (*leaf_cache_)[i]->misses;
+    }
+}
+
 template <typename P>
 inline bool mbtree<P>::insert(const key_type &k, value_type v,
                               value_type *old_v,
@@ -604,8 +959,10 @@ inline bool mbtree<P>::insert(const key_type &k, value_type v,
   threadinfo ti;
   Masstree::tcursor<P> lp(table_, k.data(), k.length());
   bool found = lp.find_insert(ti);
-  if (!found)
+  if (!found) {
     ti.observe_phantoms(lp.node());
+    size_deltas_.my()++;
+  }
   if (found && old_v)
     *old_v = lp.value();
   lp.value() = v;
@@ -614,6 +971,10 @@ inline bool mbtree<P>::insert(const key_type &k, value_type v,
     insert_info->old_version = lp.previous_full_version_value();
     insert_info->new_version = lp.next_full_version_value(1);
   }
+  // still under the leaf lock, so the point index sees updates to k in
+  // the same order the tree does
+  if (point_index_)
+    point_index_->put((const char *) k.data(), k.length(), v);
   lp.finish(1, ti);
   return !found;
 }
@@ -628,12 +989,15 @@ inline bool mbtree<P>::insert_if_absent(const key_type &k, value_type v,
   bool found = lp.find_insert(ti);
   if (!found) {
     ti.observe_phantoms(lp.node());
+    size_deltas_.my()++;
     lp.value() = v;
     if (insert_info) {
       insert_info->node = lp.node();
       insert_info->old_version = lp.previous_full_version_value();
       insert_info->new_version = lp.next_full_version_value(1);
     }
+    if (point_index_)
+      point_index_->put((const char *) k.data(), k.length(), v);
   }
   lp.finish(!found, ti);
   return !found;
@@ -654,6 +1018,10 @@ inline bool mbtree<P>::remove(const key_type &k, value_type *old_v)
   bool found = lp.find_locked(ti);
   if (found && old_v)
     *old_v = lp.value();
+  if (found)
+    size_deltas_.my()--;
+  if (found && point_index_)
+    point_index_->remove((const char *) k.data(), k.length());
   lp.finish(found ? -1 : 0, ti);
   return found;
 }
@@ -0,0 +1,450 @@
+/**
+ * microbench.cc
+ *
+ * multi-threaded microbenchmarks for the engine's building blocks, so that
+ * regressions in them show up before they do in tpcc. each thread is pinned
+ * to its own cpu and runs the same number of ops
+ *
+ * results go to stdout, one whitespace separated line per (bench, nthreads),
+ * after a '#' header line- see Columns. everything else goes to stderr
+ *
+ * usage: microbench [-t nthreads[,nthreads...]] [-s scale] [bench ...]
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "allocator.h"
+#include "core.h"
+#include "masstree_btree.h"
+#include "rcu.h"
+#include "small_unordered_map.h"
+#include "spinbarrier.h"
+#include "static_vector.h"
+#include "str_arena.h"
+#include "thread.h"
+#include "ticker.h"
+#include "tuple.h"
+#include "util.h"
+#include "varint.h"
+#include "varkey.h"
+
+using namespace std;
+using namespace util;
+
+static const char *const Columns =
+  "# bench nthreads ops_per_thread elapsed_us ns_per_op agg_mops_per_sec";
+
+struct microbench {
+  const char *name;
+  size_t nops; // per thread, before scaling
+  // setup()/teardown() run on the main thread, around the timed run
+  void (*setup)(size_t nthreads, size_t nops);
+  void (*fn)(unsigned id, size_t nops);
+  void (*teardown)();
+};
+
+static void noop_setup(size_t nthreads, size_t nops) {}
+static void noop_teardown() {}
+
+// keep the compiler from optimizing away the work
+static volatile uint64_t g_sink;
+
+// rcu::sync::alloc/dealloc
+
+static void
+rcu_alloc_dealloc(unsigned id, size_t nops)
+{
+  static const size_t Batch = 16;
+  void *px[Batch];
+  for (size_t i = 0; i < nops; i += Batch) {
+    for (size_t j = 0; j < Batch; j++)
+      px[j] = rcu::s_instance.alloc(64 + 16 * j);
+    for (size_t j = 0; j < Batch; j++)
+      rcu::s_instance.dealloc(px[j], 64 + 16 * j);
+  }
+}
+
+// ticker::guard enter/exit
+
+static void
+ticker_guard(unsigned id, size_t nops)
+{
+  for (size_t i = 0; i < nops; i++) {
+    ticker::guard g(ticker::s_instance);
+    g_sink = g.tick();
+  }
+}
+
+// dbtuple::lock/unlock- all threads on one tuple, and each on its own
+
+static vector<dbtuple *> g_tuples;
+
+static void
+tuples_setup(size_t ntuples)
+{
+  scoped_rcu_region guard;
+  for (size_t i = 0; i < ntuples; i++)
+    g_tuples.push_back(dbtuple::alloc_first(8, false));
+}
+
+static void
+tuples_teardown()
+{
+  scoped_rcu_region guard;
+  for (auto t : g_tuples) {
+    t->lock(false);
+    t->clear_latest();
+    t->unlock();
+    dbtuple::release_no_rcu(t);
+  }
+  g_tuples.clear();
+}
+
+static void
+dbtuple_lock_shared_setup(size_t nthreads, size_t nops)
+{
+  tuples_setup(1);
+}
+
+static void
+dbtuple_lock_private_setup(size_t nthreads, size_t nops)
+{
+  tuples_setup(nthreads);
+}
+
+static void
+dbtuple_lock(unsigned id, size_t nops)
+{
+  dbtuple * const t = g_tuples[id % g_tuples.size()];
+  for (size_t i = 0; i < nops; i++) {
+    t->lock(true);
+    t->unlock();
+  }
+}
+
+// small_unordered_map: fill past the small table, then look everything up
+
+static void
+small_unordered_map_ops(unsigned id, size_t nops)
+{
+  static const size_t NKeys = SMALL_SIZE_MAP;
+  fast_random r(id + 1);
+  for (size_t i = 0; i < nops; i += 2 * NKeys) {
+    small_unordered_map<uint64_t, uint64_t> m;
+    uint64_t keys[NKeys];
+    for (size_t j = 0; j < NKeys; j++)
+      m[keys[j] = r.next()] = j;
+    for (size_t j = 0; j < NKeys; j++)
+      g_sink = m.find(keys[j])->second;
+  }
+}
+
+// static_vector: append up to the static size, then walk it
+
+static void
+static_vector_ops(unsigned id, size_t nops)
+{
+  static const size_t N = SMALL_SIZE_VEC;
+  static_vector<uint64_t, N> v;
+  for (size_t i = 0; i < nops; i += N) {
+    v.clear();
+    for (size_t j = 0; j < N; j++)
+      v.emplace_back(i + j);
+    uint64_t s = 0;
+    for (auto x : v)
+      s += x;
+    g_sink = s;
+  }
+}
+
+// str_arena: hand out every string, as a txn would, then reset
+
+static void
+str_arena_ops(unsigned id, size_t nops)
+{
+  str_arena arena;
+  for (size_t i = 0; i < nops; i += str_arena::NStrs) {
+    arena.reset();
+    for (size_t j = 0; j < str_arena::NStrs; j++)
+      arena()->assign("0123456789abcdef0123456789abcdef");
+  }
+}
+
+// varint encode + decode, of values of every length
+
+static void
+varint_ops(unsigned id, size_t nops)
+{
+  static const size_t N = 1024;
+  uint32_t values[N];
+  fast_random r(id + 1);
+  for (size_t j = 0; j < N; j++)
+    values[j] = r.next_u32() >> (r.next() % 32);
+  uint8_t buf[5 * N];
+  for (size_t i = 0; i < nops; i += N) {
+    uint8_t *p = &buf[0];
+    for (size_t j = 0; j < N; j++)
+      p = write_uvint32(p, values[j]);
+    const uint8_t *q = &buf[0];
+    uint32_t v, s = 0;
+    for (size_t j = 0; j < N; j++) {
+      q = read_uvint32(q, &v);
+      s += v;
+    }
+    g_sink = s;
+  }
+}
+
+// mbtree insert (disjoint keys per thread), then search (random keys from
+// a table the threads share)
+
+static concurrent_btree *g_btree;
+
+static inline uint64_t
+scramble(uint64_t k)
+{
+  // spread each thread's keys over the whole tree
+  return k * 0x9E3779B97F4A7C15UL;
+}
+
+static void
+mbtree_insert_setup(size_t nthreads, size_t nops)
+{
+  g_btree = new concurrent_btree;
+}
+
+static void
+mbtree_search_setup(size_t nthreads, size_t nops)
+{
+  g_btree = new concurrent_btree;
+  scoped_rcu_region guard;
+  for (size_t i = 0; i < nops; i++)
+    g_btree->insert(u64_varkey(scramble(i)),
+                    (typename concurrent_btree::value_type) i);
+}
+
+static void
+mbtree_teardown()
+{
+  delete g_btree;
+  g_btree = nullptr;
+}
+
+static void
+mbtree_insert(unsigned id, size_t nops)
+{
+  static const size_t Batch = 1024; // ops per rcu region
+  for (size_t i = 0; i < nops;) {
+    scoped_rcu_region guard;
+    for (size_t j = 0; j < Batch && i < nops; j++, i++) {
+      const uint64_t k = scramble(uint64_t(id) * nops + i);
+      g_btree->insert(u64_varkey(k), (typename concurrent_btree::value_type) k);
+    }
+  }
+}
+
+static void
+mbtree_search(unsigned id, size_t nops)
+{
+  static const size_t Batch = 1024;
+  // setup() inserted nops keys
+  fast_random r(id + 1);
+  typename concurrent_btree::value_type v = 0;
+  for (size_t i = 0; i < nops;) {
+    scoped_rcu_region guard;
+    for (size_t j = 0; j < Batch && i < nops; j++, i++)
+      ALWAYS_ASSERT(g_btree->search(u64_varkey(scramble(r.next() % nops)), v));
+  }
+  g_sink = v;
+}
+
+static const microbench g_benches[] = {
+  {"rcu_alloc_dealloc", 10000000, noop_setup, rcu_alloc_dealloc, noop_teardown},
+  {"ticker_guard", 10000000, noop_setup, ticker_guard, noop_teardown},
+  {"dbtuple_lock_shared", 2000000, dbtuple_lock_shared_setup, dbtuple_lock, tuples_teardown},
+  {"dbtuple_lock_private", 10000000, dbtuple_lock_private_setup, dbtuple_lock, tuples_teardown},
+  {"small_unordered_map", 10000000, noop_setup, small_unordered_map_ops, noop_teardown},
+  {"static_vector", 10000000, noop_setup, static_vector_ops, noop_teardown},
+  {"str_arena", 10000000, noop_setup, str_arena_ops, noop_teardown},
+  {"varint", 10000000, noop_setup, varint_ops, noop_teardown},
+  {"mbtree_insert", 1000000, mbtree_insert_setup, mbtree_insert, mbtree_teardown},
+  {"mbtree_search", 1000000, mbtree_search_setup, mbtree_search, mbtree_teardown},
+};
+
+static void
+pin_to_cpu(unsigned cpu)
+{
+  // for the allocator's per-core regions (and the numa node)
+  rcu::s_instance.pin_current_thread(cpu);
+  cpu_set_t cs;
+  CPU_ZERO(&cs);
+  CPU_SET(cpu, &cs);
+  const int ret = pthread_setaffinity_np(pthread_self(), sizeof(cs), &cs);
+  if (ret) {
+    errno = ret;
+    perror("pthread_setaffinity_np");
+    ALWAYS_ASSERT(false);
+  }
+}
+
+// the bench threads' core ids, one per cpu- reused by every run, as the
+// ids cannot be recycled
+static int g_blockstart = -1;
+
+class bench_thread : public ndb_thread {
+public:
+  bench_thread(unsigned id, const microbench &b, size_t nops,
+               spin_barrier &ready, spin_barrier &go)
+    : ndb_thread(false, string("microbench-") + b.name),
+      id(id), b(b), nops(nops), ready(ready), go(go), elapsed_us(0) {}
+
+  virtual void
+  run()
+  {
+    coreid::set_core_id(g_blockstart + id);
+    pin_to_cpu(id);
+    ready.count_down();
+    go.wait_for();
+    timer t;
+    b.fn(id, nops);
+    elapsed_us = t.lap();
+  }
+
+  inline uint64_t get_elapsed_us() const { return elapsed_us; }
+
+private:
+  const unsigned id;
+  const microbench &b;
+  const size_t nops;
+  spin_barrier &ready;
+  spin_barrier &go;
+  uint64_t elapsed_us;
+};
+
+static void
+run_bench(const microbench &b, size_t nthreads, double scale)
+{
+  const size_t nops = max(size_t(1), size_t(double(b.nops) * scale));
+  b.setup(nthreads, nops);
+  spin_barrier ready(nthreads), go(1);
+  vector<bench_thread *> thds;
+  for (size_t i = 0; i < nthreads; i++)
+    thds.push_back(new bench_thread(i, b, nops, ready, go));
+  for (auto t : thds)
+    t->start();
+  ready.wait_for();
+  go.count_down();
+  uint64_t elapsed_us = 0;
+  for (auto t : thds) {
+    t->join();
+    // the run ends w/ the slowest thread
+    elapsed_us = max(elapsed_us, t->get_elapsed_us());
+    delete t;
+  }
+  b.teardown();
+  elapsed_us = max(elapsed_us, uint64_t(1));
+  cout << b.name << " " << nthreads << " " << nops << " " << elapsed_us << " "
+       << (double(elapsed_us) * 1000.0 / double(nops)) << " "
+       << (double(nops * nthreads) / double(elapsed_us)) << endl;
+}
+
+static vector<size_t>
+parse_nthreads(const string &s)
+{
+  vector<size_t> ret;
+  for (auto &p : split(s, ','))
+    ret.push_back(strtoul(p.c_str(), nullptr, 10));
+  return ret;
+}
+
+class main_thread : public ndb_thread {
+public:
+  main_thread(int argc, char **argv)
+    : ndb_thread(false, string("main")),
+      argc(argc), argv(argv), ret(0)
+  {}
+
+  virtual void
+  run()
+  {
+#ifdef CHECK_INVARIANTS
+    cerr << "WARNING: microbenchmarks are running with invariant checking" << endl;
+#endif
+    vector<size_t> nthreads = {1};
+    double scale = 1.0;
+    vector<string> names;
+    for (int i = 1; i < argc; i++) {
+      if (!strcmp(argv[i], "-t") && i + 1 < argc)
+        nthreads = parse_nthreads(argv[++i]);
+      else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+        scale = strtod(argv[++i], nullptr);
+      else
+        names.push_back(argv[i]);
+    }
+    const size_t ncpus = coreid::num_cpus_online();
+    for (auto n : nthreads) {
+      if (n == 0 || n > ncpus) {
+        cerr << "[usage] " << argv[0]
+             << " [-t nthreads[,nthreads...]] [-s scale] [bench ...]" << endl
+             << "nthreads must be in [1, " << ncpus << "]" << endl;
+        ret = 1;
+        return;
+      }
+    }
+    for (auto &n : names) {
+      if (find_if(begin(g_benches), end(g_benches),
+                  [&n](const microbench &b) { return n == b.name; }) ==
+          end(g_benches)) {
+        cerr << "unknown bench " << n << ", have:";
+        for (auto &b : g_benches)
+          cerr << " " << b.name;
+        cerr << endl;
+        ret = 1;
+        return;
+      }
+    }
+
+    ::allocator::Initialize(ncpus, size_t(256 * (1<<20)));
+    pin_to_cpu(0);
+    g_blockstart = coreid::allocate_contiguous_aligned_block(ncpus, ncpus);
+    ALWAYS_ASSERT(g_blockstart >= 0);
+
+    cout << Columns << endl;
+    for (auto &b : g_benches) {
+      if (!names.empty() &&
+          find(names.begin(), names.end(), b.name) == names.end())
+        continue;
+      for (auto n : nthreads)
+        run_bench(b, n, scale);
+    }
+  }
+
+  inline int
+  retval() const
+  {
+    return ret;
+  }
+private:
+  const int argc;
+  char **const argv;
+  volatile int ret;
+};
+
+int
+main(int argc, char **argv)
+{
+  main_thread t(argc, argv);
+  t.start();
+  t.join();
+  return t.retval();
+}
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+#include "macros.h"
+#include "rcu.h"
+#include "spinlock.h"
+#include "lockguard.h"
+#include "third-party/lz4/xxhash.h"
+
+/**
+ * Hash index over the keys of a tree, mapping each to the same value the
+ * tree does- a shortcut for point lookups of keys which are present. It
+ * is only ever a cache of the tree's contents: a miss says nothing about
+ * whether the key exists, so callers fall back to the tree (and to its
+ * node versions for absent keys).
+ *
+ * Readers are lock free, and must be in an RCU region. Writers are
+ * serialized by one lock, which also covers doubling the bucket array
+ * when it fills up- point indexes are meant for tables whose key sets
+ * rarely change. Writers must be in an RCU region too, and must keep the
+ * tree and the point index in sync by updating both under the tree's
+ * lock for the key
+ */
+template <typename Value>
+class point_index {
+public:
+
+  static const size_t MinBuckets = 64;
+
+  point_index()
+    : table_(alloc_table(MinBuckets)), nentries_(0) {}
+
+  ~point_index()
+  {
+    free_table(table_.load(std::memory_order_relaxed));
+  }
+
+  point_index(const point_index &) = delete;
+  point_index(point_index &&) = delete;
+  point_index &operator=(const point_index &) = delete;
+
+  inline bool
+  search(const char *k, size_t klen, Value &v) const
+  {
+    const uint32_t h = hash(k, klen);
+    const table *t = table_.load(std::memory_order_acquire);
+    for (const entry *e = t->bucket(h).load(std::memory_order_acquire);
+         e;
+         e = e->next.load(std::memory_order_acquire)) {
+      if (e->matches(h, k, klen)) {
+        v = e->value.load(std::memory_order_acquire);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // inserts k, or overwrites its value
+  void
+  put(const char *k, size_t klen, Value v)
+  {
+    INVARIANT(rcu::s_instance.in_rcu_region());
+    const uint32_t h = hash(k, klen);
+    ::lock_guard<spinlock> l(lock_);
+    table *t = table_.load(std::memory_order_relaxed);
+    std::atomic<entry *> &b = t->bucket(h);
+    for (entry *e = b.load(std::memory_order_relaxed);
+         e;
+         e = e->next.load(std::memory_order_relaxed)) {
+      if (e->matches(h, k, klen)) {
+        e->value.store(v, std::memory_order_release);
+        return;
+      }
+    }
+    entry * const e = alloc_entry(h, k, klen, v);
+    e->next.store(b.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    b.store(e, std::memory_order_release);
+    if (++nentries_ > t->nbuckets)
+      grow();
+  }
+
+  void
+  remove(const char *k, size_t klen)
+  {
+    INVARIANT(rcu::s_instance.in_rcu_region());
+    const uint32_t h = hash(k, klen);
+    ::lock_guard<spinlock> l(lock_);
+    table *t = table_.load(std::memory_order_relaxed);
+    std::atomic<entry *> *pp = &t->bucket(h);
+    for (entry *e = pp->load(std::memory_order_relaxed);
+         e;
+         pp = &e->next, e = pp->load(std::memory_order_relaxed)) {
+      if (e->matches(h, k, klen)) {
+        // readers already on e can still follow its next pointer
+        pp->store(e->next.load(std::memory_order_relaxed),
+                  std::memory_order_release);
+        rcu::s_instance.dealloc_rcu(e, e->alloc_size());
+        nentries_--;
+        return;
+      }
+    }
+  }
+
+  // NOT THREAD SAFE
+  void
+  clear()
+  {
+    free_table(table_.load(std::memory_order_relaxed));
+    table_.store(alloc_table(MinBuckets), std::memory_order_relaxed);
+    nentries_ = 0;
+  }
+
+  // not exact under concurrent writers
+  inline size_t
+  size() const
+  {
+    return nentries_;
+  }
+
+private:
+
+  struct entry {
+    std::atomic<entry *> next;
+    std::atomic<Value> value;
+    uint32_t hash;
+    uint32_t keylen;
+    char key[0];
+
+    inline size_t
+    alloc_size() const
+    {
+      return sizeof(entry) + keylen;
+    }
+
+    inline bool
+    matches(uint32_t h, const char *k, size_t klen) const
+    {
+      return hash == h && keylen == klen && !memcmp(key, k, klen);
+    }
+  };
+
+  struct table {
+    size_t nbuckets; // power of two
+    std::atomic<entry *> buckets[0];
+
+    inline std::atomic<entry *> &
+    bucket(uint32_t h)
+    {
+      return buckets[h & (nbuckets - 1)];
+    }
+
+    inline const std::atomic<entry *> &
+    bucket(uint32_t h) const
+    {
+      return buckets[h & (nbuckets - 1)];
+    }
+
+    inline size_t
+    alloc_size() const
+    {
+      return sizeof(table) + nbuckets * sizeof(buckets[0]);
+    }
+  };
+
+  static inline uint32_t
+  hash(const char *k, size_t klen)
+  {
+    return XXH32(k, klen, 0);
+  }
+
+  static entry *
+  alloc_entry(uint32_t h, const char *k, size_t klen, Value v)
+  {
+    entry * const e =
+      reinterpret_cast<entry *>(rcu::s_instance.alloc(sizeof(entry) + klen));
+    new (&e->next) std::atomic<entry *>(nullptr);
+    new (&e->value) std::atomic<Value>(v);
+    e->hash = h;
+    e->keylen = klen;
+    NDB_MEMCPY(&e->key[0], k, klen);
+    return e;
+  }
+
+  static table *
+  alloc_table(size_t nbuckets)
+  {
+    INVARIANT(!(nbuckets & (nbuckets - 1)));
+    table * const t = reinterpret_cast<table *>(rcu::s_instance.alloc(
+          sizeof(table) + nbuckets * sizeof(std::atomic<entry *>)));
+    t->nbuckets = nbuckets;
+    for (size_t i = 0; i < nbuckets; i++)
+      new (&t->buckets[i]) std::atomic<entry *>(nullptr);
+    return t;
+  }
+
+  // frees t and its entries right away- nobody may be reading them
+  static void
+  free_table(table *t)
+  {
+    for (size_t i = 0; i < t->nbuckets; i++) {
+      entry *e = t->buckets[i].load(std::memory_order_relaxed);
+      while (e) {
+        entry * const next = e->next.load(std::memory_order_relaxed);
+        rcu::s_instance.dealloc(e, e->alloc_size());
+        e = next;
+      }
+    }
+    rcu::s_instance.dealloc(t, t->alloc_size());
+  }
+
+  // doubles the bucket array, copying the entries over so that readers
+  // still walking the old chains are undisturbed. called with lock_ held
+  void
+  grow()
+  {
+    table * const t = table_.load(std::memory_order_relaxed);
+    table * const nt = alloc_table(t->nbuckets * 2);
+    for (size_t i = 0; i < t->nbuckets; i++) {
+      for (entry *e = t->buckets[i].load(std::memory_order_relaxed);
+           e;
+           e = e->next.load(std::memory_order_relaxed)) {
+        entry * const ne = alloc_entry(
+            e->hash, &e->key[0], e->keylen,
+            e->value.load(std::memory_order_relaxed));
+        std::atomic<entry *> &b = nt->bucket(e->hash);
+        ne->next.store(b.load(std::memory_order_relaxed),
+                       std::memory_order_relaxed);
+        b.store(ne, std::memory_order_relaxed);
+      }
+    }
+    table_.store(nt, std::memory_order_release);
+    for (size_t i = 0; i < t->nbuckets; i++) {
+      entry *e = t->buckets[i].load(std::memory_order_relaxed);
+      while (e) {
+        entry * const next = e->next.load(std::memory_order_relaxed);
+        rcu::s_instance.dealloc_rcu(e, e->alloc_size());
+        e = next;
+      }
+    }
+    rcu::s_instance.dealloc_rcu(t, t->alloc_size());
+  }
+
+  std::atomic<table *> table_;
+  size_t nentries_; // guarded by lock_
+  spinlock lock_;
+};
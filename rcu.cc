@@ -18,6 +18,7 @@ using namespace std;
 using namespace util;
 
 rcu rcu::s_instance;
+bool rcu::g_sticky_placement = false;
 
 static event_counter evt_rcu_deletes("rcu_deletes");
 static event_counter evt_rcu_frees("rcu_frees");
@@ -27,6 +28,7 @@ static event_counter evt_rcu_loop_reaps("rcu_loop_reaps");
 static event_counter *evt_allocator_arena_allocations[::allocator::MAX_ARENAS] = {nullptr};
 static event_counter *evt_allocator_arena_deallocations[::allocator::MAX_ARENAS] = {nullptr};
 static event_counter evt_allocator_large_allocation("allocator_large_allocation");
+static event_counter evt_allocator_foreign_allocation("allocator_foreign_allocation");
 
 static event_avg_counter evt_avg_gc_reaper_queue_len("avg_gc_reaper_queue_len");
 static event_avg_counter evt_avg_rcu_delete_queue_len("avg_rcu_delete_queue_len");
@@ -101,9 +103,14 @@ check_pointer_or_die(void *p, size_t alloc_size)
 #endif
 
 void *
-rcu::sync::alloc(size_t sz)
+rcu::sync::alloc_on(ssize_t cpu, size_t sz)
 {
-  if (pin_cpu_ == -1)
+  if (cpu == -1)
+    cpu = pin_cpu_;
+  if (cpu == -1 && ::allocator::IsPersistent())
+    // everything has to live in the regions to survive a restart
+    cpu = 0;
+  if (cpu == -1)
     // fallback to regular allocator
     return malloc(sz);
   auto sizes = ::allocator::ArenaSize(sz);
@@ -111,8 +118,12 @@ rcu::sync::alloc(size_t sz)
   if (arena >= ::allocator::MAX_ARENAS) {
     // fallback to regular allocator
     ++evt_allocator_large_allocation;
+    if (::allocator::IsPersistent())
+      ::allocator::NoteEscapedAllocation();
     return malloc(sz);
   }
+  if (unlikely(cpu != pin_cpu_))
+    return alloc_foreign(cpu, arena);
   ensure_arena(arena);
   void *p = arenas_[arena];
   INVARIANT(p);
@@ -125,6 +136,28 @@ rcu::sync::alloc(size_t sz)
   return p;
 }
 
+void *
+rcu::sync::alloc_foreign(size_t cpu, size_t arena)
+{
+  if (unlikely(foreign_cpu_ != ssize_t(cpu))) {
+    ::allocator::ReleaseArenas(&foreign_arenas_[0]);
+    NDB_MEMSET(&foreign_arenas_[0], 0, sizeof(foreign_arenas_));
+    foreign_cpu_ = cpu;
+  }
+  if (unlikely(!foreign_arenas_[arena]))
+    foreign_arenas_[arena] = ::allocator::AllocateArenas(cpu, arena);
+  void *p = foreign_arenas_[arena];
+  INVARIANT(p);
+#ifdef MEMCHECK_MAGIC
+  const size_t alloc_size = (arena + 1) * ::allocator::AllocAlignment;
+  check_pointer_or_die(p, alloc_size);
+#endif
+  foreign_arenas_[arena] = *reinterpret_cast<void **>(p);
+  evt_allocator_arena_allocations[arena]->inc();
+  ++evt_allocator_foreign_allocation;
+  return p;
+}
+
 void *
 rcu::sync::alloc_static(size_t sz)
 {
@@ -195,6 +228,8 @@ rcu::sync::do_release()
   ::allocator::ReleaseArenas(&arenas_[0]);
   NDB_MEMSET(&arenas_[0], 0, sizeof(arenas_));
   NDB_MEMSET(&deallocs_[0], 0, sizeof(deallocs_));
+  ::allocator::ReleaseArenas(&foreign_arenas_[0]);
+  NDB_MEMSET(&foreign_arenas_[0], 0, sizeof(foreign_arenas_));
 }
 
 void
@@ -252,6 +287,19 @@ rcu::sync::do_cleanup()
   }
 }
 
+void
+rcu::sync::drain()
+{
+  ALWAYS_ASSERT(!depth_);
+  // the frees themselves may queue more frees, so go until nothing is left
+  while (!queue_.empty()) {
+    do_cleanup();
+    if (!queue_.empty())
+      std::this_thread::sleep_for(std::chrono::microseconds(ticker::tick_us));
+  }
+  do_release();
+}
+
 void
 rcu::free_with_fn(void *p, deleter_t fn)
 {
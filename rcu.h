@@ -107,6 +107,14 @@ public:
     size_t deallocs_[allocator::MAX_ARENAS]; // keeps track of the number of
                                              // un-released deallocations
 
+    // placement hint (see scoped_placement_hint), -1 for none
+    ssize_t placement_cpu_;
+
+    // arenas claimed from a region other than pin_cpu_'s- we only cache
+    // these for one foreign region at a time
+    ssize_t foreign_cpu_;
+    void *foreign_arenas_[allocator::MAX_ARENAS];
+
   public:
 
     sync(rcu *impl)
@@ -118,12 +126,15 @@ public:
 #endif
       , impl_(impl)
       , pin_cpu_(-1)
+      , placement_cpu_(-1)
+      , foreign_cpu_(-1)
     {
       ALWAYS_ASSERT(((uintptr_t)this % CACHELINE_SIZE) == 0);
       queue_.alloc_freelist(NQueueGroups);
       scratch_.alloc_freelist(NQueueGroups);
       NDB_MEMSET(&arenas_[0], 0, sizeof(arenas_));
       NDB_MEMSET(&deallocs_[0], 0, sizeof(deallocs_));
+      NDB_MEMSET(&foreign_arenas_[0], 0, sizeof(foreign_arenas_));
     }
 
     inline void
@@ -138,9 +149,32 @@ public:
       return pin_cpu_;
     }
 
+    inline ssize_t
+    get_placement_cpu() const
+    {
+      return placement_cpu_;
+    }
+
+    // returns the previous hint
+    inline ssize_t
+    set_placement_cpu(ssize_t cpu)
+    {
+      const ssize_t ret = placement_cpu_;
+      placement_cpu_ = cpu;
+      return ret;
+    }
+
     // allocate a block of memory of size sz. caller needs to remember
     // the size of the allocation when calling free
-    void *alloc(size_t sz);
+    inline void *
+    alloc(size_t sz)
+    {
+      return alloc_on(placement_cpu_, sz);
+    }
+
+    // like alloc(), but from cpu's region (-1 means our own). works for
+    // unpinned threads too, as long as cpu is given
+    void *alloc_on(ssize_t cpu, size_t sz);
 
     // allocates a block of memory of size sz, with the intention of never
     // free-ing it. is meant for reasonably large allocations (order of pages)
@@ -156,12 +190,20 @@ public:
 
     void do_cleanup();
 
+    // runs everything still queued, waiting out the ticks it is due at, and
+    // hands the local arenas back to the allocator. for a thread which is
+    // about to go away (no one else ever runs its queue). must not be called
+    // from within an rcu region
+    void drain();
+
     inline unsigned depth() const { return depth_; }
 
   private:
 
     void do_release();
 
+    void *alloc_foreign(size_t cpu, size_t arena);
+
     inline void
     ensure_arena(size_t arena)
     {
@@ -185,6 +227,27 @@ public:
     return mysync().alloc_static(sz);
   }
 
+  // allocates sz bytes in the same region as p, so that new versions of a
+  // record stay where the record lives. only in effect when
+  // g_sticky_placement is set, and an explicit placement hint wins
+  inline void *
+  alloc_near(const void *p, size_t sz)
+  {
+    sync &s = mysync();
+    if (!g_sticky_placement ||
+        s.get_placement_cpu() != -1 ||
+        !::allocator::ManagesPointer(p))
+      return s.alloc(sz);
+    return s.alloc_on(::allocator::PointerToCpu(p), sz);
+  }
+
+  // returns the previous hint
+  inline ssize_t
+  set_placement_hint(ssize_t cpu)
+  {
+    return mysync().set_placement_cpu(cpu);
+  }
+
   // this releases memory back to the allocator subsystem
   // this should NOT be used to free objects!
   inline void
@@ -207,6 +270,12 @@ public:
     mysync().do_cleanup();
   }
 
+  inline void
+  drain()
+  {
+    mysync().drain();
+  }
+
   void free_with_fn(void *p, deleter_t fn);
 
   template <typename T>
@@ -265,6 +334,9 @@ public:
 
   static rcu s_instance CACHE_ALIGNED; // system wide instance
 
+  // see alloc_near()
+  static bool g_sticky_placement;
+
   static void Test();
 
 private:
@@ -328,6 +400,28 @@ private:
 
 typedef scoped_rcu_base<true> scoped_rcu_region;
 
+// allocations made by the current thread while in scope come from cpu's
+// allocator region (and therefore cpu's numa node), instead of the region
+// of the cpu the thread is pinned to. meant for placing a partition's
+// records on its home node, regardless of which worker inserts them
+class scoped_placement_hint {
+public:
+  scoped_placement_hint(const scoped_placement_hint &) = delete;
+  scoped_placement_hint(scoped_placement_hint &&) = delete;
+  scoped_placement_hint &operator=(const scoped_placement_hint &) = delete;
+
+  scoped_placement_hint(ssize_t cpu)
+    : prev_(rcu::s_instance.set_placement_hint(cpu)) {}
+
+  ~scoped_placement_hint()
+  {
+    rcu::s_instance.set_placement_hint(prev_);
+  }
+
+private:
+  ssize_t prev_;
+};
+
 class disabled_rcu_region {};
 
 #endif /* _RCU_H_ */
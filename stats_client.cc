@@ -26,11 +26,13 @@ main(int argc, char **argv)
 {
   if (argc != 3) {
     cerr << "[usage] " << argv[0] << " sockfile counterspec" << endl;
+    cerr << "  counterspec is ':' separated names, or '-' for all" << endl;
     return 1;
   }
 
   const string sockfile(argv[1]);
-  const vector<string> counter_names = split(argv[2], ':');
+  const vector<string> counter_names =
+    string(argv[2]) == "-" ? vector<string>() : split(argv[2], ':');
 
   int fd = socket(AF_UNIX, SOCK_STREAM, 0);
   if (fd < 0)
@@ -47,42 +49,48 @@ main(int argc, char **argv)
     throw system_error(errno, system_category(),
         "connecting to socket");
 
+  // one subscription for all the counters: the server pushes their values
+  // every interval, in a single packet
+  string req(1, (char) stats_command::SUBSCRIBE);
+  const uint32_t interval_ms = 1;
+  req.append((const char *) &interval_ms, sizeof(interval_ms));
+  for (auto &name : counter_names) {
+    req.append(name);
+    req.push_back('\0');
+  }
+
   packet pkt;
   int r;
-  timer loop_timer;
+  pkt.assign(req);
+  if ((r = pkt.sendpkt(fd))) {
+    perror("send - disconnecting");
+    return 1;
+  }
   for (;;) {
-    for (auto &name : counter_names) {
-      uint8_t buf[1 + name.size()];
-      buf[0] = (uint8_t) stats_command::GET_COUNTER_VALUE;
-      memcpy(&buf[1], name.data(), name.size());
-      pkt.assign((const char *) &buf[0], sizeof(buf));
-      if ((r = pkt.sendpkt(fd))) {
-        perror("send - disconnecting");
-        return 1;
-      }
-      if ((r = pkt.recvpkt(fd))) {
-        if (r == EOF)
-          return 0;
-        perror("recv - disconnecting");
-        return 1;
-      }
-      const get_counter_value_t *resp = (const get_counter_value_t *) pkt.data();
+    if ((r = pkt.recvpkt(fd))) {
+      if (r == EOF)
+        return 0;
+      perror("recv - disconnecting");
+      return 1;
+    }
+    const get_counter_values_t *resp =
+      (const get_counter_values_t *) pkt.data();
+    if (resp->truncated_)
+      cerr << "warning: not all counters fit in the reply" << endl;
+    const char *p = pkt.data() + sizeof(*resp);
+    for (size_t i = 0; i < resp->nentries_; i++) {
+      uint16_t len;
+      memcpy(&len, p, sizeof(len));
+      const string name(p + sizeof(len), len);
+      p += sizeof(len) + len;
+      counter_data d;
+      memcpy(&d, p, sizeof(d));
+      p += sizeof(d);
       cout << name                << " "
            << resp->timestamp_us_ << " "
-           << resp->d_.count_     << " "
-           << resp->d_.sum_       << " "
-           << resp->d_.max_       << endl;
-    }
-
-    const uint64_t last_loop_usec  = loop_timer.lap();
-    //const uint64_t delay_time_usec = 1000000;
-    const uint64_t delay_time_usec = 1000000/1000;
-    if (last_loop_usec < delay_time_usec) {
-      const uint64_t sleep_ns = (delay_time_usec - last_loop_usec) * 1000;
-      struct timespec t;
-      t.tv_sec  = sleep_ns / ONE_SECOND_NS;
-      t.tv_nsec = sleep_ns % ONE_SECOND_NS;
-      nanosleep(&t, nullptr);
+           << d.count_            << " "
+           << d.sum_              << " "
+           << d.max_              << endl;
     }
   }
 
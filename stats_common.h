@@ -4,13 +4,58 @@
 #include "macros.h"
 #include "fileutils.h"
 
-enum class stats_command : uint8_t { GET_COUNTER_VALUE = 0x1 };
+enum class stats_command : uint8_t {
+  GET_COUNTER_VALUE = 0x1,
+  // payload is a uint64_t timestamp (usec). the reply is text: the column
+  // header line (starting w/ '#'), then every published sample newer than
+  // the timestamp, oldest first, one per line- as many as fit in a packet
+  GET_SAMPLES = 0x2,
+  // reply is the '\n' separated names of all counters
+  LIST_COUNTERS = 0x3,
+  // payload is '\0' separated counter names, or nothing for all counters.
+  // the reply is a get_counter_values_t, see below
+  GET_COUNTER_VALUES = 0x4,
+  // payload is a uint32_t interval (msec), then names as for
+  // GET_COUNTER_VALUES. there is no direct reply- instead the server pushes
+  // the GET_COUNTER_VALUES reply every interval, until the client
+  // disconnects. the connection takes no further commands
+  SUBSCRIBE = 0x5,
+  // reply is all counters in the prometheus text exposition format. if they
+  // do not all fit in a packet, the reply ends w/ a "# TRUNCATED" line
+  GET_TEXT = 0x6,
+  // payload is the name of an event_hist_counter, reply is a
+  // get_histogram_t (all zeros if there is no such histogram)
+  GET_HISTOGRAM = 0x7,
+  // payload is a table name, or nothing for all tables. the reply is text,
+  // one line per key the conflict_sampler has most often seen commits fail
+  // on: "table count error hexkey", most conflicted first within a table
+  GET_CONFLICTS = 0x8,
+};
 
 struct get_counter_value_t {
   uint64_t timestamp_us_; // usec
   counter_data d_;
 };
 
+// followed by nentries_ of [uint16_t namelen | name | counter_data].
+// truncated_ is set if some counters did not fit in the packet
+struct get_counter_values_t {
+  uint64_t timestamp_us_; // usec
+  uint32_t nentries_;
+  uint32_t truncated_;
+};
+
+struct get_histogram_t {
+  uint64_t timestamp_us_; // usec
+  uint64_t count_;
+  uint64_t sum_;
+  uint64_t max_;
+  uint64_t p50_;
+  uint64_t p90_;
+  uint64_t p99_;
+  uint64_t p999_;
+};
+
 class packet {
 public:
   static const size_t MAX_DATA = 0xFFFF - 4;
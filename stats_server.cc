@@ -1,10 +1,19 @@
+#include <cctype>
+#include <deque>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <sstream>
 #include <system_error>
-#include <thread>
 
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 
+#include "conflict_sampler.h"
 #include "counter.h"
 #include "stats_server.h"
 #include "util.h"
@@ -12,6 +21,19 @@
 using namespace std;
 using namespace util;
 
+static mutex g_samples_lock;
+static string g_sample_header;
+static deque<pair<uint64_t, string>> g_samples;
+
+// same framing as packet::sendpkt()
+static void
+queue_packet(string &out, const packet &pkt)
+{
+  const uint32_t n = pkt.size();
+  out.append((const char *) &n, sizeof(n));
+  out.append(pkt.data(), n);
+}
+
 stats_server::stats_server(const string &sockfile)
   : sockfile_(sockfile) {}
 
@@ -39,14 +61,241 @@ stats_server::serve_forever()
     throw system_error(errno, system_category(),
         "listening on " + sockfile_);
 
+  // a subscriber going away mid push must not take the process down
+  signal(SIGPIPE, SIG_IGN);
+
+  // one thread multiplexes all clients: pending requests are answered in
+  // turn, and subscriptions are pushed as they come due
+  vector<client> clients;
+  vector<struct pollfd> pfds;
+  packet pkt;
   for (;;) {
-    int cfd = accept(fd, nullptr, 0);
-    if (cfd < 0)
-      throw system_error(errno, system_category(), "accept failed");
-    thread(&stats_server::serve_client, this, cfd).detach();
+    pfds.clear();
+    pfds.push_back({fd, POLLIN, 0});
+    uint64_t next_push_us = numeric_limits<uint64_t>::max();
+    for (auto &c : clients) {
+      const short events = c.out_.empty() ? POLLIN : (POLLIN | POLLOUT);
+      pfds.push_back({c.fd_, events, 0});
+      if (c.interval_us_)
+        next_push_us = min(next_push_us, c.next_push_us_);
+    }
+    int timeout_ms = -1;
+    if (next_push_us != numeric_limits<uint64_t>::max()) {
+      const uint64_t now_us = timer::cur_usec();
+      timeout_ms = next_push_us > now_us ?
+        int((next_push_us - now_us + 999) / 1000) : 0;
+    }
+    if (poll(&pfds[0], pfds.size(), timeout_ms) < 0) {
+      if (errno == EINTR)
+        continue;
+      throw system_error(errno, system_category(), "poll failed");
+    }
+
+    // pfds[i + 1] is clients[i]; walk backwards so dropping is cheap
+    for (size_t i = clients.size(); i-- > 0;) {
+      client &c = clients[i];
+      bool drop = false;
+      if (pfds[i + 1].revents & (POLLIN | POLLHUP | POLLERR))
+        drop = !read_requests(c, pkt);
+      if (!drop && c.interval_us_ && timer::cur_usec() >= c.next_push_us_) {
+        // skip pushes we are too late for, rather than bursting them out-
+        // this includes the ones a subscriber has not taken the last one
+        // for yet
+        c.next_push_us_ =
+          max(c.next_push_us_ + c.interval_us_, timer::cur_usec());
+        if (c.out_.empty()) {
+          handle_cmd_get_counter_values(c.names_, pkt);
+          queue_packet(c.out_, pkt);
+        }
+      }
+      if (!drop && !c.out_.empty())
+        drop = !write_replies(c);
+      if (drop) {
+        close(c.fd_);
+        clients.erase(clients.begin() + i);
+      }
+    }
+
+    if (pfds[0].revents & POLLIN) {
+      int cfd = accept(fd, nullptr, 0);
+      if (cfd < 0)
+        throw system_error(errno, system_category(), "accept failed");
+      if (fcntl(cfd, F_SETFL, fcntl(cfd, F_GETFL) | O_NONBLOCK) < 0)
+        throw system_error(errno, system_category(), "fcntl failed");
+      clients.emplace_back(cfd);
+    }
   }
 }
 
+bool
+stats_server::read_requests(client &c, packet &pkt)
+{
+  // one read per wakeup, so a chatty client cannot starve the others
+  char buf[4096];
+  const ssize_t r = read(c.fd_, buf, sizeof(buf));
+  if (r == 0) {
+    cerr << "client disconnected" << endl;
+    return false;
+  }
+  if (r < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+      return true;
+    perror("recv- dropping connection");
+    return false;
+  }
+  c.in_.append(buf, r);
+
+  // answer every request received in full (same framing as
+  // packet::recvpkt())
+  size_t off = 0;
+  uint32_t n;
+  while (c.in_.size() - off >= sizeof(n)) {
+    NDB_MEMCPY(&n, c.in_.data() + off, sizeof(n));
+    if (n > packet::MAX_DATA) {
+      cerr << "bad packet read with excessive size- dropping connection"
+           << endl;
+      return false;
+    }
+    if (c.in_.size() - off - sizeof(n) < n)
+      break;
+    if (c.interval_us_) {
+      cerr << "command from a subscriber- dropping connection" << endl;
+      return false;
+    }
+    pkt.assign(c.in_.data() + off + sizeof(n), n);
+    off += sizeof(n) + n;
+    if (!handle_packet(c, pkt))
+      return false;
+  }
+  c.in_.erase(0, off);
+  if (c.out_.size() > MaxPendingOutput) {
+    cerr << "client not reading replies- dropping connection" << endl;
+    return false;
+  }
+  return true;
+}
+
+bool
+stats_server::write_replies(client &c)
+{
+  const ssize_t r = write(c.fd_, c.out_.data(), c.out_.size());
+  if (r < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+      return true;
+    perror("send- dropping connection");
+    return false;
+  }
+  c.out_.erase(0, r);
+  return true;
+}
+
+static vector<string>
+split_names(const char *p, size_t n)
+{
+  vector<string> ret;
+  const char * const end = p + n;
+  while (p < end) {
+    const char *q = (const char *) memchr(p, '\0', end - p);
+    if (!q)
+      q = end;
+    if (q != p)
+      ret.emplace_back(p, q - p);
+    p = q + 1;
+  }
+  return ret;
+}
+
+bool
+stats_server::handle_packet(client &c, packet &pkt)
+{
+  if (!pkt.size()) {
+    cerr << "empty packet- dropping connection" << endl;
+    return false;
+  }
+  switch (pkt.data()[0]) {
+  case static_cast<uint8_t>(stats_command::GET_COUNTER_VALUE):
+    {
+      const string name(pkt.data() + 1, pkt.size() - 1);
+      if (!handle_cmd_get_counter_value(name, pkt)) {
+        cerr << "error on handle_cmd_get_counter_value(), dropping" << endl;
+        return false;
+      }
+      break;
+    }
+  case static_cast<uint8_t>(stats_command::GET_SAMPLES):
+    {
+      uint64_t since_us = 0;
+      if (pkt.size() != 1 + sizeof(since_us)) {
+        cerr << "bad GET_SAMPLES request- dropping connection" << endl;
+        return false;
+      }
+      memcpy(&since_us, pkt.data() + 1, sizeof(since_us));
+      if (!handle_cmd_get_samples(since_us, pkt)) {
+        cerr << "error on handle_cmd_get_samples(), dropping" << endl;
+        return false;
+      }
+      break;
+    }
+  case static_cast<uint8_t>(stats_command::LIST_COUNTERS):
+    if (!handle_cmd_list_counters(pkt)) {
+      cerr << "error on handle_cmd_list_counters(), dropping" << endl;
+      return false;
+    }
+    break;
+  case static_cast<uint8_t>(stats_command::GET_COUNTER_VALUES):
+    if (!handle_cmd_get_counter_values(
+          split_names(pkt.data() + 1, pkt.size() - 1), pkt)) {
+      cerr << "error on handle_cmd_get_counter_values(), dropping" << endl;
+      return false;
+    }
+    break;
+  case static_cast<uint8_t>(stats_command::SUBSCRIBE):
+    {
+      uint32_t interval_ms = 0;
+      if (pkt.size() < 1 + sizeof(interval_ms)) {
+        cerr << "bad SUBSCRIBE request- dropping connection" << endl;
+        return false;
+      }
+      memcpy(&interval_ms, pkt.data() + 1, sizeof(interval_ms));
+      c.interval_us_ =
+        max(uint64_t(interval_ms), uint64_t(MinSubscribeIntervalMs)) * 1000;
+      c.next_push_us_ = timer::cur_usec();
+      c.names_ = split_names(pkt.data() + 1 + sizeof(interval_ms),
+                             pkt.size() - 1 - sizeof(interval_ms));
+      // the first push goes out right away
+      return true;
+    }
+  case static_cast<uint8_t>(stats_command::GET_TEXT):
+    if (!handle_cmd_get_text(pkt)) {
+      cerr << "error on handle_cmd_get_text(), dropping" << endl;
+      return false;
+    }
+    break;
+  case static_cast<uint8_t>(stats_command::GET_HISTOGRAM):
+    {
+      const string name(pkt.data() + 1, pkt.size() - 1);
+      if (!handle_cmd_get_histogram(name, pkt)) {
+        cerr << "error on handle_cmd_get_histogram(), dropping" << endl;
+        return false;
+      }
+      break;
+    }
+  case static_cast<uint8_t>(stats_command::GET_CONFLICTS):
+    {
+      const string table(pkt.data() + 1, pkt.size() - 1);
+      if (!handle_cmd_get_conflicts(table, pkt)) {
+        cerr << "error on handle_cmd_get_conflicts(), dropping" << endl;
+        return false;
+      }
+      break;
+    }
+  default:
+    cerr << "bad command- dropping connection" << endl;
+    return false;
+  }
+  queue_packet(c.out_, pkt);
+  return true;
+}
 
 bool
 stats_server::handle_cmd_get_counter_value(const string &name, packet &pkt)
@@ -59,36 +308,215 @@ stats_server::handle_cmd_get_counter_value(const string &name, packet &pkt)
   return true;
 }
 
-void
-stats_server::serve_client(int fd)
+bool
+stats_server::handle_cmd_get_counter_values(
+    const vector<string> &names, packet &pkt)
 {
-  packet pkt;
-  string scratch;
-  for (;;) {
-    int r = pkt.recvpkt(fd);
-    if (r == EOF) {
-      cerr << "client disconnected" << endl;
+  // a single pass over all counters (under their lock) is much cheaper than
+  // one stat() per name
+  const map<string, counter_data> all = event_counter::get_all_counters();
+  get_counter_values_t hdr;
+  hdr.timestamp_us_ = timer::cur_usec();
+  hdr.nentries_ = 0;
+  hdr.truncated_ = 0;
+  string ret((const char *) &hdr, sizeof(hdr));
+  const auto append = [&](const string &name, const counter_data &d) {
+    const uint16_t len = name.size();
+    if (ret.size() + sizeof(len) + len + sizeof(d) > packet::MAX_DATA) {
+      hdr.truncated_ = 1;
       return;
     }
-    if (r) {
-      perror("recv- dropping connection");
-      return;
+    ret.append((const char *) &len, sizeof(len));
+    ret.append(name);
+    ret.append((const char *) &d, sizeof(d));
+    hdr.nentries_++;
+  };
+  if (names.empty()) {
+    for (auto &p : all)
+      append(p.first, p.second);
+  } else {
+    for (auto &n : names) {
+      auto it = all.find(n);
+      if (it == all.end()) {
+        cerr << "could not find counter " << n << endl;
+        append(n, counter_data());
+        continue;
+      }
+      append(n, it->second);
     }
-    INVARIANT(pkt.size());
-    switch (pkt.data()[0]) {
-    case static_cast<uint8_t>(stats_command::GET_COUNTER_VALUE):
-      {
-        scratch.assign(pkt.data() + 1, pkt.size() - 1);
-        if (!handle_cmd_get_counter_value(scratch, pkt)) {
-          cerr << "error on handle_cmd_get_counter_value(), dropping" << endl;
-          return;
-        }
-        pkt.sendpkt(fd);
+  }
+  NDB_MEMCPY(&ret[0], &hdr, sizeof(hdr));
+  pkt.assign(ret);
+  return true;
+}
+
+bool
+stats_server::handle_cmd_list_counters(packet &pkt)
+{
+  string ret;
+  for (auto &p : event_counter::get_all_counters()) {
+    if (ret.size() + p.first.size() + 1 > packet::MAX_DATA) {
+      cerr << "counter list truncated" << endl;
+      break;
+    }
+    ret += p.first;
+    ret += '\n';
+  }
+  pkt.assign(ret);
+  return true;
+}
+
+// prometheus metric names are [a-zA-Z_:][a-zA-Z0-9_:]*
+static string
+prometheus_name(const string &name)
+{
+  string ret = "silo_";
+  for (char c : name)
+    ret += (isalnum(c) || c == '_' || c == ':') ? c : '_';
+  return ret;
+}
+
+bool
+stats_server::handle_cmd_get_histogram(const string &name, packet &pkt)
+{
+  get_histogram_t ret;
+  NDB_MEMSET(&ret, 0, sizeof(ret));
+  ret.timestamp_us_ = timer::cur_usec();
+  event_hist_counter::histogram_type h;
+  if (event_hist_counter::stat_hist(name, h)) {
+    ret.count_ = h.count();
+    ret.sum_ = h.sum();
+    ret.max_ = h.max();
+    ret.p50_ = h.percentile(50.0);
+    ret.p90_ = h.percentile(90.0);
+    ret.p99_ = h.percentile(99.0);
+    ret.p999_ = h.percentile(99.9);
+  } else {
+    cerr << "could not find histogram " << name << endl;
+  }
+  pkt.assign((const char *) &ret, sizeof(ret));
+  return true;
+}
+
+bool
+stats_server::handle_cmd_get_conflicts(const string &table, packet &pkt)
+{
+  string ret;
+  for (auto &p : conflict_sampler::top()) {
+    if (!table.empty() && p.first != table)
+      continue;
+    for (auto &e : p.second) {
+      ostringstream buf;
+      buf << e.table_ << " " << e.count_ << " " << e.error_ << " "
+          << hexify(e.key_) << "\n";
+      const string s = buf.str();
+      if (ret.size() + s.size() > packet::MAX_DATA)
         break;
+      ret += s;
+    }
+  }
+  pkt.assign(ret);
+  return true;
+}
+
+bool
+stats_server::handle_cmd_get_text(packet &pkt)
+{
+  // a cut off export ends in this comment, so scrapers can tell
+  static const string truncated = "# TRUNCATED\n";
+  const size_t max_data = packet::MAX_DATA - truncated.size();
+  const uint64_t ts_ms = timer::cur_usec() / 1000;
+  const map<string, event_hist_counter::histogram_type> hists =
+    event_hist_counter::get_all_histograms();
+  ostringstream buf;
+  string ret;
+  for (auto &p : event_counter::get_all_counters()) {
+    const string n = prometheus_name(p.first);
+    buf.str("");
+    if (p.second.type_ == counter_data::TYPE_AGG) {
+      // event_avg_counter: a summary w/o quantiles, plus the max.
+      // event_hist_counter: the same, w/ quantiles
+      buf << "# TYPE " << n << " summary\n";
+      auto it = hists.find(p.first);
+      if (it != hists.end()) {
+        static const double qs[] = {50.0, 90.0, 99.0, 99.9};
+        for (double q : qs)
+          buf << n << "{quantile=\"" << (q / 100.0) << "\"} "
+              << it->second.percentile(q) << " " << ts_ms << "\n";
       }
-    default:
-      cerr << "bad command- dropping connection" << endl;
-      return;
+      buf << n << "_count " << p.second.count_ << " " << ts_ms << "\n"
+          << n << "_sum " << p.second.sum_ << " " << ts_ms << "\n"
+          << "# TYPE " << n << "_max gauge\n"
+          << n << "_max " << p.second.max_ << " " << ts_ms << "\n";
+    } else {
+      buf << "# TYPE " << n << " counter\n"
+          << n << " " << p.second.count_ << " " << ts_ms << "\n";
+    }
+    const string s = buf.str();
+    if (ret.size() + s.size() > max_data) {
+      cerr << "text export truncated" << endl;
+      pkt.assign(ret + truncated);
+      return true;
+    }
+    ret += s;
+  }
+  // the top conflicted keys, as one gauge labelled by table and key
+  bool first = true;
+  for (auto &p : conflict_sampler::top()) {
+    for (auto &e : p.second) {
+      buf.str("");
+      if (first)
+        buf << "# TYPE silo_conflict_key_count gauge\n";
+      buf << "silo_conflict_key_count{table=\"" << e.table_ << "\",key=\""
+          << hexify(e.key_) << "\"} " << e.count_ << " " << ts_ms << "\n";
+      const string s = buf.str();
+      if (ret.size() + s.size() > max_data) {
+        cerr << "text export truncated" << endl;
+        pkt.assign(ret + truncated);
+        return true;
+      }
+      first = false;
+      ret += s;
     }
   }
+  pkt.assign(ret);
+  return true;
+}
+
+void
+stats_server::set_sample_header(const string &header)
+{
+  lock_guard<mutex> l(g_samples_lock);
+  g_sample_header = header;
+  g_samples.clear();
+}
+
+void
+stats_server::publish_sample(uint64_t timestamp_us, const string &line)
+{
+  lock_guard<mutex> l(g_samples_lock);
+  if (g_samples.size() == MaxSamples)
+    g_samples.pop_front();
+  g_samples.emplace_back(timestamp_us, line);
+}
+
+bool
+stats_server::handle_cmd_get_samples(uint64_t since_us, packet &pkt)
+{
+  string ret;
+  {
+    lock_guard<mutex> l(g_samples_lock);
+    ret = g_sample_header + "\n";
+    for (auto &p : g_samples) {
+      if (p.first <= since_us)
+        continue;
+      if (ret.size() + p.second.size() + 1 > packet::MAX_DATA)
+        // the client asks again from the last timestamp it got
+        break;
+      ret += p.second;
+      ret += '\n';
+    }
+  }
+  pkt.assign(ret);
+  return true;
 }
@@ -1,15 +1,53 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include "stats_common.h"
 
-// serves over unix socket
+// serves over unix socket. all clients are served from the one thread
+// calling serve_forever(), so scraping never competes w/ the workers for
+// more than a single core. client sockets are non-blocking, so a slow or
+// stuck client cannot hold up the others
 class stats_server {
 public:
   stats_server(const std::string &sockfile);
   void serve_forever(); // blocks current thread
+
+  // a time series (ie the bench sampler's) to hand out on GET_SAMPLES.
+  // lines are space separated columns, the first being a timestamp (usec).
+  // only the most recent MaxSamples lines are kept
+  static const size_t MaxSamples = 4096;
+  static void set_sample_header(const std::string &header);
+  static void publish_sample(uint64_t timestamp_us, const std::string &line);
+
+  static const uint64_t MinSubscribeIntervalMs = 1;
+
+  // a client w/ more than this many bytes of replies it has not read yet
+  // is dropped
+  static const size_t MaxPendingOutput = 1 << 20;
 private:
+  struct client {
+    client(int fd) : fd_(fd), interval_us_(0), next_push_us_(0) {}
+    int fd_;
+    uint64_t interval_us_; // 0 if not subscribed
+    uint64_t next_push_us_;
+    std::vector<std::string> names_; // empty for all counters
+    std::string in_;  // start of a request not fully received yet
+    std::string out_; // replies not fully sent yet
+  };
+
+  // all return false if the client should be dropped
+  bool read_requests(client &c, packet &pkt);
+  bool write_replies(client &c);
+  bool handle_packet(client &c, packet &pkt);
+
   bool handle_cmd_get_counter_value(const std::string &name, packet &pkt);
-  void serve_client(int fd);
+  bool handle_cmd_get_counter_values(
+      const std::vector<std::string> &names, packet &pkt);
+  bool handle_cmd_list_counters(packet &pkt);
+  bool handle_cmd_get_text(packet &pkt);
+  bool handle_cmd_get_histogram(const std::string &name, packet &pkt);
+  bool handle_cmd_get_conflicts(const std::string &table, packet &pkt);
+  bool handle_cmd_get_samples(uint64_t since_us, packet &pkt);
   std::string sockfile_;
 };
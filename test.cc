@@ -17,6 +17,7 @@
 #include "small_unordered_map.h"
 #include "static_unordered_map.h"
 #include "counter.h"
+#include "conflict_sampler.h"
 #include "record/encoder.h"
 #include "record/inline_str.h"
 #include "record/cursor.h"
@@ -52,6 +53,7 @@ using namespace util;
 static event_counter evt_test("test");
 static event_counter evt_test1("test1");
 static event_avg_counter evt_test_avg("test_avg");
+static event_hist_counter evt_test_hist("test_hist");
 
 namespace varkeytest {
   void
@@ -249,10 +251,59 @@ CounterTest()
   ALWAYS_ASSERT(m["test_avg"].sum_ == 6);
   ALWAYS_ASSERT(m["test_avg"].max_ == 3);
 
+  for (uint64_t i = 1; i <= 100; i++)
+    evt_test_hist.offer(i);
+  m = event_counter::get_all_counters();
+  ALWAYS_ASSERT(m["test_hist"].type_ == counter_data::TYPE_AGG);
+  ALWAYS_ASSERT(m["test_hist"].count_ == 100);
+  ALWAYS_ASSERT(m["test_hist"].sum_ == 5050);
+  ALWAYS_ASSERT(m["test_hist"].max_ == 100);
+  event_hist_counter::histogram_type h;
+  ALWAYS_ASSERT(event_hist_counter::stat_hist("test_hist", h));
+  ALWAYS_ASSERT(!event_hist_counter::stat_hist("test_avg", h));
+  // within the bucket width (25%) of the exact percentiles
+  ALWAYS_ASSERT(h.percentile(50.0) >= 50 && h.percentile(50.0) <= 63);
+  ALWAYS_ASSERT(h.percentile(99.0) >= 99 && h.percentile(99.0) <= 100);
+
   cout << "event counters test passed" << endl;
 #endif
 }
 
+void
+ConflictSamplerTest()
+{
+  const bool was_enabled = conflict_sampler::g_enabled;
+  conflict_sampler::g_enabled = true;
+  conflict_sampler::reset();
+  int t0, t1; // stand-ins for tables
+  conflict_sampler::register_table(&t0, "t0");
+  conflict_sampler::register_table(&t1, "t1");
+  // a few hot keys among many more cold ones than the sketch has slots
+  for (size_t i = 0; i < 1000; i++) {
+    conflict_sampler::offer(&t0, "hot0");
+    if (i % 2 == 0)
+      conflict_sampler::offer(&t1, "hot1");
+    conflict_sampler::offer(&t0, "cold" + to_string(i));
+  }
+  auto m = conflict_sampler::top(2);
+  ALWAYS_ASSERT(m.size() == 2);
+  ALWAYS_ASSERT(m["t0"].size() == 2);
+  ALWAYS_ASSERT(m["t0"][0].key_ == "hot0");
+  ALWAYS_ASSERT(m["t0"][0].count_ - m["t0"][0].error_ <= 1000);
+  ALWAYS_ASSERT(m["t0"][0].count_ >= 1000);
+  ALWAYS_ASSERT(m["t1"].size() == 1);
+  ALWAYS_ASSERT(m["t1"][0].key_ == "hot1");
+  ALWAYS_ASSERT(m["t1"][0].count_ == 500);
+  ALWAYS_ASSERT(m["t1"][0].error_ == 0);
+
+  conflict_sampler::unregister_table(&t0);
+  conflict_sampler::unregister_table(&t1);
+  conflict_sampler::reset();
+  ALWAYS_ASSERT(conflict_sampler::top().empty());
+  conflict_sampler::g_enabled = was_enabled;
+  cout << "conflict sampler test passed" << endl;
+}
+
 void
 UtilTest()
 {
@@ -980,6 +1031,7 @@ public:
     //varkeytest::Test();
     //pxqueuetest::Test();
     //CounterTest();
+    //ConflictSamplerTest();
     //UtilTest();
     //varint::Test();
     //small_vector_ns::Test();
@@ -3,6 +3,7 @@
 #include <cstdint>
 #include <atomic>
 #include <thread>
+#include <chrono>
 
 #include "core.h"
 #include "macros.h"
@@ -19,7 +20,7 @@ public:
 #endif
 
   ticker()
-    : current_tick_(1), last_tick_inclusive_(0)
+    : current_tick_(1), last_tick_inclusive_(0), fast_forward_tick_(0)
   {
     std::thread thd(&ticker::tickerloop, this);
     thd.detach();
@@ -53,6 +54,20 @@ public:
     return e;
   }
 
+  // moves the global tick to at least tick (eg. to resume past the epochs
+  // of a reattached heap), blocking until the ticker has done so
+  void
+  fast_forward(uint64_t tick)
+  {
+    uint64_t cur = fast_forward_tick_.load(std::memory_order_acquire);
+    while (cur < tick &&
+           !fast_forward_tick_.compare_exchange_weak(
+             cur, tick, std::memory_order_acq_rel))
+      ;
+    while (global_current_tick() < tick)
+      std::this_thread::sleep_for(std::chrono::microseconds(tick_us));
+  }
+
   // returns true if guard is currently active, along with filling
   // cur_epoch out
   inline bool
@@ -195,10 +210,12 @@ private:
         loop_timer.lap(); // since we slept away the lag
       }
 
-      // bump the current tick
+      // bump the current tick (or jump it, if asked to)
       // XXX: ignore overflow
-      const uint64_t last_tick = util::non_atomic_fetch_add(current_tick_, 1UL);
-      const uint64_t cur_tick  = last_tick + 1;
+      const uint64_t last_tick = current_tick_.load(std::memory_order_acquire);
+      const uint64_t cur_tick  = std::max(
+          last_tick + 1, fast_forward_tick_.load(std::memory_order_acquire));
+      current_tick_.store(cur_tick, std::memory_order_release);
 
       // wait for all threads to finish the last tick
       for (size_t i = 0; i < ticks_.size(); i++) {
@@ -213,7 +230,7 @@ private:
         ti.current_tick_.store(cur_tick, std::memory_order_release);
       }
 
-      last_tick_inclusive_.store(last_tick, std::memory_order_release);
+      last_tick_inclusive_.store(cur_tick - 1, std::memory_order_release);
     }
   }
 
@@ -238,4 +255,5 @@ private:
   std::atomic<uint64_t> last_tick_inclusive_;
     // all threads have *completed* ticks <= last_tick_inclusive_
     // (< current_tick_)
+  std::atomic<uint64_t> fast_forward_tick_; // see fast_forward()
 };
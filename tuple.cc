@@ -1,14 +1,17 @@
+#include <lz4.h>
+
 #include "tuple.h"
 #include "txn.h"
+#include "evict_store.h"
 
 using namespace std;
 using namespace util;
 
-event_avg_counter dbtuple::g_evt_avg_dbtuple_stable_version_spins
+event_hist_counter dbtuple::g_evt_avg_dbtuple_stable_version_spins
   ("avg_dbtuple_stable_version_spins");
-event_avg_counter dbtuple::g_evt_avg_dbtuple_lock_acquire_spins
+event_hist_counter dbtuple::g_evt_avg_dbtuple_lock_acquire_spins
   ("avg_dbtuple_lock_acquire_spins");
-event_avg_counter dbtuple::g_evt_avg_dbtuple_read_retries
+event_hist_counter dbtuple::g_evt_avg_dbtuple_read_retries
   ("avg_dbtuple_read_retries");
 
 event_counter dbtuple::g_evt_dbtuple_creates("dbtuple_creates");
@@ -19,6 +22,17 @@ event_counter dbtuple::g_evt_dbtuple_bytes_freed("dbtuple_bytes_freed");
 event_counter dbtuple::g_evt_dbtuple_spills("dbtuple_spills");
 event_counter dbtuple::g_evt_dbtuple_inplace_buf_insufficient("dbtuple_inplace_buf_insufficient");
 event_counter dbtuple::g_evt_dbtuple_inplace_buf_insufficient_on_spill("dbtuple_inplace_buf_insufficient_on_spill");
+event_counter dbtuple::g_evt_dbtuple_compactions("dbtuple_compactions");
+event_counter dbtuple::g_evt_dbtuple_compaction_bytes_reclaimed("dbtuple_compaction_bytes_reclaimed");
+event_counter dbtuple::g_evt_dbtuple_cold_compressions("dbtuple_cold_compressions");
+event_counter dbtuple::g_evt_dbtuple_cold_compression_bytes_saved("dbtuple_cold_compression_bytes_saved");
+event_counter dbtuple::g_evt_dbtuple_cold_reads("dbtuple_cold_reads");
+event_counter dbtuple::g_evt_dbtuple_cold_inflations("dbtuple_cold_inflations");
+event_counter dbtuple::g_evt_dbtuple_evictions("dbtuple_evictions");
+event_counter dbtuple::g_evt_dbtuple_eviction_bytes_saved("dbtuple_eviction_bytes_saved");
+event_counter dbtuple::g_evt_dbtuple_fault_ins("dbtuple_fault_ins");
+event_counter dbtuple::g_evt_dbtuple_migrations("dbtuple_migrations");
+event_counter dbtuple::g_evt_dbtuple_tombstone_purges("dbtuple_tombstone_purges");
 
 event_avg_counter dbtuple::g_evt_avg_record_spill_len("avg_record_spill_len");
 static event_avg_counter evt_avg_dbtuple_chain_length("avg_dbtuple_chain_len");
@@ -49,6 +63,189 @@ dbtuple::gc_this()
   release(this);
 }
 
+#ifdef TUPLE_COLD_COMPRESSION
+// scratch space for (de)compressing under a tuple lock
+static __thread string *tl_compress_buf = nullptr;
+
+static inline string &
+compress_buf()
+{
+  if (unlikely(!tl_compress_buf))
+    tl_compress_buf = new string;
+  return *tl_compress_buf;
+}
+
+bool
+dbtuple::inflate(uint8_t *dst, size_t dst_sz) const
+{
+  INVARIANT(is_compressed());
+  node_size_type clen;
+  NDB_MEMCPY(&clen, &value_start[0], sizeof(clen));
+  if (unlikely(sizeof(clen) + clen > alloc_size))
+    return false;
+  const int ret = LZ4_decompress_safe(
+      (const char *) &value_start[sizeof(clen)], (char *) dst, clen, dst_sz);
+  return ret >= 0 && size_t(ret) == dst_sz;
+}
+
+dbtuple *
+dbtuple::alloc_compressed(const dbtuple *base)
+{
+  INVARIANT(base->is_locked());
+  INVARIANT(base->is_latest());
+  INVARIANT(!base->is_deleting());
+  INVARIANT(!base->is_compressed());
+  string &buf = compress_buf();
+  buf.resize(LZ4_compressBound(base->size));
+  const int ret = LZ4_compress_limitedOutput(
+      (const char *) base->get_value_start(), &buf[0], base->size, buf.size());
+  if (ret <= 0)
+    return nullptr;
+  const size_type alloc_sz =
+    compacted_alloc_size(sizeof(node_size_type) + size_type(ret));
+  if (alloc_sz >= compacted_alloc_size(base->size))
+    // incompressible, at least as far as the allocator is concerned
+    return nullptr;
+  char *p = reinterpret_cast<char *>(
+      rcu::s_instance.alloc_near(base, alloc_sz + sizeof(dbtuple)));
+  INVARIANT(p);
+  return new (p) dbtuple(base, (const uint8_t *) buf.data(), ret, alloc_sz);
+}
+
+dbtuple::write_record_ret
+dbtuple::write_compressed_record_at(
+    tid_t t, const void *v, tuple_writer_t writer)
+{
+  CheckMagic();
+  INVARIANT(is_locked());
+  INVARIANT(is_lock_owner());
+  INVARIANT(is_latest());
+  INVARIANT(is_write_intent());
+  INVARIANT(is_compressed());
+  INVARIANT(!is_deleting() && size);
+
+  string &buf = compress_buf();
+  const size_t old_sz = size;
+  buf.resize(old_sz);
+  uint8_t * const old_v = (uint8_t *) &buf[0];
+  // we hold the lock, so there is nobody to race with
+  ALWAYS_ASSERT(inflate(old_v, old_sz));
+
+  const size_t new_sz =
+    v ? writer(TUPLE_WRITER_COMPUTE_NEEDED, v, old_v, old_sz) : 0;
+  INVARIANT(!v || new_sz);
+  if (!new_sz)
+    ++g_evt_dbtuple_logical_deletes;
+
+  const bool needs_old_value =
+    writer(TUPLE_WRITER_NEEDS_OLD_VALUE, nullptr, nullptr, 0);
+  dbtuple * const rep =
+    alloc_spill(t, old_v, old_sz, new_sz, this, true, needs_old_value);
+  if (v)
+    writer(TUPLE_WRITER_DO_WRITE, v, rep->get_value_start(), old_sz);
+  INVARIANT(rep->is_latest());
+  INVARIANT(rep->size == new_sz);
+  INVARIANT(new_sz || rep->is_deleting()); // set by alloc_spill()
+  clear_latest();
+  ++g_evt_dbtuple_cold_inflations;
+  return write_record_ret(rep, this, true);
+}
+#endif
+
+#ifdef TUPLE_ANTI_CACHING
+// scratch space for faulting values back in under a tuple lock
+static __thread string *tl_evict_buf = nullptr;
+
+static inline string &
+evict_buf()
+{
+  if (unlikely(!tl_evict_buf))
+    tl_evict_buf = new string;
+  return *tl_evict_buf;
+}
+
+static inline uint64_t
+evicted_offset(const dbtuple *stub)
+{
+  uint64_t off;
+  NDB_MEMCPY(&off, stub->get_value_start(), sizeof(off));
+  return off;
+}
+
+dbtuple *
+dbtuple::alloc_evicted(const dbtuple *base)
+{
+  INVARIANT(base->is_locked());
+  INVARIANT(base->is_latest());
+  INVARIANT(!base->is_deleting());
+  INVARIANT(!base->is_evicted());
+  if (!evict_store::s_instance.is_open())
+    return nullptr;
+  const uint64_t off =
+    evict_store::s_instance.append(base->get_value_start(), base->size);
+  const size_type alloc_sz = compacted_alloc_size(sizeof(off));
+  char *p = reinterpret_cast<char *>(
+      rcu::s_instance.alloc_near(base, alloc_sz + sizeof(dbtuple)));
+  INVARIANT(p);
+  return new (p) dbtuple(base, off, alloc_sz);
+}
+
+dbtuple *
+dbtuple::alloc_resident(const dbtuple *stub)
+{
+  INVARIANT(stub->is_locked());
+  INVARIANT(stub->is_latest());
+  INVARIANT(stub->is_evicted());
+  string &buf = evict_buf();
+  buf.resize(stub->size);
+  evict_store::s_instance.read(
+      evicted_offset(stub), (uint8_t *) &buf[0], stub->size);
+  dbtuple * const rep =
+    alloc_spill(stub->version, (const_record_type) buf.data(), stub->size,
+                stub->size, stub->next, true, true);
+  ++g_evt_dbtuple_fault_ins;
+  return rep;
+}
+
+dbtuple::write_record_ret
+dbtuple::write_evicted_record_at(
+    tid_t t, const void *v, tuple_writer_t writer)
+{
+  CheckMagic();
+  INVARIANT(is_locked());
+  INVARIANT(is_lock_owner());
+  INVARIANT(is_latest());
+  INVARIANT(is_write_intent());
+  INVARIANT(is_evicted());
+  INVARIANT(!is_deleting() && size);
+
+  string &buf = evict_buf();
+  const size_t old_sz = size;
+  buf.resize(old_sz);
+  uint8_t * const old_v = (uint8_t *) &buf[0];
+  evict_store::s_instance.read(evicted_offset(this), old_v, old_sz);
+
+  const size_t new_sz =
+    v ? writer(TUPLE_WRITER_COMPUTE_NEEDED, v, old_v, old_sz) : 0;
+  INVARIANT(!v || new_sz);
+  if (!new_sz)
+    ++g_evt_dbtuple_logical_deletes;
+
+  const bool needs_old_value =
+    writer(TUPLE_WRITER_NEEDS_OLD_VALUE, nullptr, nullptr, 0);
+  dbtuple * const rep =
+    alloc_spill(t, old_v, old_sz, new_sz, this, true, needs_old_value);
+  if (v)
+    writer(TUPLE_WRITER_DO_WRITE, v, rep->get_value_start(), old_sz);
+  INVARIANT(rep->is_latest());
+  INVARIANT(rep->size == new_sz);
+  INVARIANT(new_sz || rep->is_deleting()); // set by alloc_spill()
+  clear_latest();
+  ++g_evt_dbtuple_fault_ins;
+  return write_record_ret(rep, this, true);
+}
+#endif
+
 string
 dbtuple::VersionInfoStr(version_t v)
 {
@@ -68,7 +265,8 @@ static ostream &
 format_tuple(ostream &o, const dbtuple &t)
 {
   string truncated_contents(
-      (const char *) &t.value_start[0], min(static_cast<size_t>(t.size), 16UL));
+      (const char *) &t.value_start[0],
+      min(static_cast<size_t>(min(t.size, t.alloc_size)), 16UL));
   o << &t << " [tid=" << g_proto_version_str(t.version)
     << ", size=" << t.size
     << ", contents=0x" << hexify(truncated_contents) << (t.size > 16 ? "..." : "")
@@ -81,6 +279,8 @@ dbtuple::print(ostream &o, unsigned len) const
 {
   o << "dbtuple:" << endl
     << "  hdr=" << VersionInfoStr(unstable_version())
+    << endl << "  kind="
+    << (is_compressed() ? "COMP" : (is_evicted() ? "EVICT" : "-"))
 #ifdef TUPLE_CHECK_KEY
     << endl << "  key=" << hexify(key)
     << endl << "  tree=" << tree
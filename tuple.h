@@ -99,6 +99,11 @@ private:
   static const version_t HDR_VERSION_SHIFT = 5;
   static const version_t HDR_VERSION_MASK = ((version_t)-1) << HDR_VERSION_SHIFT;
 
+  // what the value buffer holds, see kind
+  static const uint8_t KIND_PLAIN = 0;
+  static const uint8_t KIND_COMPRESSED = 1; // [ clen | lz4 bytes ]
+  static const uint8_t KIND_EVICTED = 2;    // [ evict_off ]
+
 public:
 
 #ifdef TUPLE_MAGIC
@@ -117,8 +122,13 @@ public:
   inline ALWAYS_INLINE void CheckMagic() const {}
 #endif
 
+  // fixed for the lifetime of a tuple (compressing or evicting one replaces
+  // it), so unlike the bits in hdr it needs no version check- keeping it out
+  // of hdr leaves the version counter its full width
+  const uint8_t kind;
+
   // NB(stephentu): ABA problem happens after some multiple of
-  // 2^(NBits(version_t)-6) concurrent modifications- somewhat low probability
+  // 2^(NBits(version_t)-5) concurrent modifications- somewhat low probability
   // event, so we let it happen
   //
   // <-- low bits
@@ -143,6 +153,12 @@ public:
                  // GC is capable of reaping it at certain (well defined)
                  // points, and will not bother to set it to null
 
+#ifdef TUPLE_TRACK_ACCESS
+  // low bits of the ticker tick of the last read- only maintained
+  // on the head of the chain, racy on purpose
+  mutable uint8_t access_tick;
+#endif
+
 #ifdef TUPLE_CHECK_KEY
   // for debugging
   std::string key;
@@ -180,6 +196,7 @@ private:
 #ifdef TUPLE_MAGIC
       magic(TUPLE_MAGIC),
 #endif
+      kind(KIND_PLAIN),
       hdr(HDR_LATEST_MASK |
           (acquire_lock ? (HDR_LOCKED_MASK | HDR_WRITE_INTENT_MASK) : 0) |
           (!size ? HDR_DELETING_MASK : 0))
@@ -190,6 +207,9 @@ private:
       , size(CheckBounds(size))
       , alloc_size(CheckBounds(alloc_size))
       , next(nullptr)
+#ifdef TUPLE_TRACK_ACCESS
+      , access_tick(CurrentAccessTick())
+#endif
 #ifdef TUPLE_CHECK_KEY
       , key()
       , tree(nullptr)
@@ -223,6 +243,7 @@ private:
 #ifdef TUPLE_MAGIC
       magic(TUPLE_MAGIC),
 #endif
+      kind(KIND_PLAIN),
       hdr(set_latest ? HDR_LATEST_MASK : 0)
 #ifdef TUPLE_LOCK_OWNERSHIP_CHECKING
       , lock_owner()
@@ -231,6 +252,9 @@ private:
       , size(base->size)
       , alloc_size(CheckBounds(alloc_size))
       , next(base->next)
+#ifdef TUPLE_TRACK_ACCESS
+      , access_tick(base->access_tick)
+#endif
 #ifdef TUPLE_CHECK_KEY
       , key()
       , tree(nullptr)
@@ -262,6 +286,7 @@ private:
 #ifdef TUPLE_MAGIC
       magic(TUPLE_MAGIC),
 #endif
+      kind(KIND_PLAIN),
       hdr((set_latest ? HDR_LATEST_MASK : 0) | (!new_size ? HDR_DELETING_MASK : 0))
 #ifdef TUPLE_LOCK_OWNERSHIP_CHECKING
       , lock_owner()
@@ -270,6 +295,9 @@ private:
       , size(CheckBounds(new_size))
       , alloc_size(CheckBounds(alloc_size))
       , next(next)
+#ifdef TUPLE_TRACK_ACCESS
+      , access_tick(CurrentAccessTick())
+#endif
 #ifdef TUPLE_CHECK_KEY
       , key()
       , tree(nullptr)
@@ -288,12 +316,87 @@ private:
     g_evt_dbtuple_bytes_allocated += alloc_size + sizeof(dbtuple);
   }
 
+#ifdef TUPLE_COLD_COMPRESSION
+  // creates a compressed copy of base, inheriting its version, chain and
+  // (logical) size. the value buffer holds [ clen | lz4 bytes ]
+  dbtuple(const struct dbtuple *base,
+          const uint8_t *compressed,
+          size_type compressed_size,
+          size_type alloc_size)
+    :
+#ifdef TUPLE_MAGIC
+      magic(TUPLE_MAGIC),
+#endif
+      kind(KIND_COMPRESSED),
+      hdr(HDR_LATEST_MASK)
+#ifdef TUPLE_LOCK_OWNERSHIP_CHECKING
+      , lock_owner()
+#endif
+      , version(base->version)
+      , size(base->size)
+      , alloc_size(CheckBounds(alloc_size))
+      , next(base->next)
+      , access_tick(base->access_tick)
+#ifdef TUPLE_CHECK_KEY
+      , key()
+      , tree(nullptr)
+#endif
+#ifdef CHECK_INVARIANTS
+      , opaque(0)
+#endif
+  {
+    INVARIANT(sizeof(node_size_type) + compressed_size <= alloc_size);
+    INVARIANT(!base->is_deleting());
+    const node_size_type clen = CheckBounds(compressed_size);
+    NDB_MEMCPY(&value_start[0], &clen, sizeof(clen));
+    NDB_MEMCPY(&value_start[sizeof(clen)], compressed, compressed_size);
+    ++g_evt_dbtuple_creates;
+    g_evt_dbtuple_bytes_allocated += alloc_size + sizeof(dbtuple);
+  }
+#endif
+
+#ifdef TUPLE_ANTI_CACHING
+  // creates a stub for base, whose value now lives at evict_off in the
+  // evict_store. inherits version, chain and (logical) size
+  dbtuple(const struct dbtuple *base,
+          uint64_t evict_off,
+          size_type alloc_size)
+    :
+#ifdef TUPLE_MAGIC
+      magic(TUPLE_MAGIC),
+#endif
+      kind(KIND_EVICTED),
+      hdr(HDR_LATEST_MASK)
+#ifdef TUPLE_LOCK_OWNERSHIP_CHECKING
+      , lock_owner()
+#endif
+      , version(base->version)
+      , size(base->size)
+      , alloc_size(CheckBounds(alloc_size))
+      , next(base->next)
+      , access_tick(base->access_tick)
+#ifdef TUPLE_CHECK_KEY
+      , key()
+      , tree(nullptr)
+#endif
+#ifdef CHECK_INVARIANTS
+      , opaque(0)
+#endif
+  {
+    INVARIANT(sizeof(evict_off) <= alloc_size);
+    INVARIANT(!base->is_deleting());
+    NDB_MEMCPY(&value_start[0], &evict_off, sizeof(evict_off));
+    ++g_evt_dbtuple_creates;
+    g_evt_dbtuple_bytes_allocated += alloc_size + sizeof(dbtuple);
+  }
+#endif
+
   friend class rcu;
   ~dbtuple();
 
-  static event_avg_counter g_evt_avg_dbtuple_stable_version_spins;
-  static event_avg_counter g_evt_avg_dbtuple_lock_acquire_spins;
-  static event_avg_counter g_evt_avg_dbtuple_read_retries;
+  static event_hist_counter g_evt_avg_dbtuple_stable_version_spins;
+  static event_hist_counter g_evt_avg_dbtuple_lock_acquire_spins;
+  static event_hist_counter g_evt_avg_dbtuple_read_retries;
 
 public:
 
@@ -301,6 +404,7 @@ public:
     READ_FAILED,
     READ_EMPTY,
     READ_RECORD,
+    READ_EVICTED, // the value must be faulted back in first
   };
 
   inline void
@@ -489,6 +593,44 @@ public:
     return v & HDR_LATEST_MASK;
   }
 
+  // compressed-ness is fixed for the lifetime of a tuple
+  inline bool
+  is_compressed() const
+  {
+    return kind == KIND_COMPRESSED;
+  }
+
+  // so is evicted-ness: faulting a tuple back in replaces it
+  inline bool
+  is_evicted() const
+  {
+    return kind == KIND_EVICTED;
+  }
+
+#ifdef TUPLE_TRACK_ACCESS
+  static inline uint8_t
+  CurrentAccessTick()
+  {
+    return uint8_t(ticker::s_instance.global_current_tick());
+  }
+
+  inline void
+  touch() const
+  {
+    // avoid dirtying the cacheline when we can help it
+    const uint8_t now = CurrentAccessTick();
+    if (access_tick != now)
+      access_tick = now;
+  }
+
+  // number of ticks since the last read (modulo wrap-around)
+  inline uint8_t
+  idle_ticks() const
+  {
+    return uint8_t(CurrentAccessTick() - access_tick);
+  }
+#endif
+
   inline void
   clear_latest()
   {
@@ -630,6 +772,22 @@ private:
   };
 #endif
 
+#ifdef TUPLE_COLD_COMPRESSION
+  // inflates the value into a string from sa and hands that to reader.
+  // fails if we raced with a writer- caller must re-check the version
+  template <typename Reader, typename StringAllocator>
+  inline bool
+  read_compressed(size_t read_sz, Reader &reader, StringAllocator &sa) const
+  {
+    std::string * const px = sa();
+    px->resize(read_sz);
+    if (unlikely(!inflate((uint8_t *) &(*px)[0], read_sz)))
+      return false;
+    ++g_evt_dbtuple_cold_reads;
+    return reader((const uint8_t *) px->data(), read_sz, sa);
+  }
+#endif
+
   // written to be non-recursive
   template <typename Reader, typename StringAllocator>
   static ReadStatus
@@ -650,6 +808,16 @@ private:
     if (found) {
       start_t = current->version;
       const size_t read_sz = IsDeleting(v) ? 0 : current->size;
+#ifdef TUPLE_ANTI_CACHING
+      if (unlikely(read_sz && current->is_evicted()))
+        return READ_EVICTED;
+#endif
+#ifdef TUPLE_COLD_COMPRESSION
+      if (unlikely(current->is_compressed())) {
+        if (unlikely(read_sz && !current->read_compressed(read_sz, reader, sa)))
+          goto retry;
+      } else
+#endif
       if (unlikely(read_sz && !reader(current->get_value_start(), read_sz, sa)))
         goto retry;
       if (unlikely(!current->reader_check_version(v)))
@@ -704,6 +872,19 @@ private:
       //  return READ_FAILED;
       start_t = version;
       const size_t read_sz = IsDeleting(v) ? 0 : size;
+#ifdef TUPLE_TRACK_ACCESS
+      touch();
+#endif
+#ifdef TUPLE_ANTI_CACHING
+      if (unlikely(read_sz && is_evicted()))
+        return READ_EVICTED;
+#endif
+#ifdef TUPLE_COLD_COMPRESSION
+      if (unlikely(is_compressed())) {
+        if (unlikely(read_sz && !read_compressed(read_sz, reader, sa)))
+          goto retry;
+      } else
+#endif
       if (unlikely(read_sz && !reader(get_value_start(), read_sz, sa)))
         goto retry;
       if (unlikely(!reader_check_version(v)))
@@ -855,6 +1036,14 @@ public:
   write_record_at(const Transaction *txn, tid_t t,
                   const void *v, tuple_writer_t writer)
   {
+#ifdef TUPLE_COLD_COMPRESSION
+    if (unlikely(is_compressed()))
+      return write_compressed_record_at(t, v, writer);
+#endif
+#ifdef TUPLE_ANTI_CACHING
+    if (unlikely(is_evicted()))
+      return write_evicted_record_at(t, v, writer);
+#endif
 #ifndef DISABLE_OVERWRITE_IN_PLACE
     CheckMagic();
     INVARIANT(is_locked());
@@ -986,6 +1175,44 @@ public:
 #endif
   }
 
+#ifdef TUPLE_COLD_COMPRESSION
+  // compressed records are never overwritten in place: the old value is
+  // inflated and the write always spills into a regular tuple, leaving
+  // this one on the chain for older readers
+  write_record_ret
+  write_compressed_record_at(tid_t t, const void *v, tuple_writer_t writer);
+
+  // inflates the value of a compressed tuple into [dst, dst + dst_sz),
+  // where dst_sz must be the (logical) size of the record
+  bool inflate(uint8_t *dst, size_t dst_sz) const;
+
+  /**
+   * Returns a compressed copy of base (which should be locked), or nullptr
+   * if compressing base would not land it in a smaller allocation
+   */
+  static dbtuple *alloc_compressed(const dbtuple *base);
+#endif
+
+#ifdef TUPLE_ANTI_CACHING
+  // like write_compressed_record_at(), except the old value is read back
+  // from the evict_store (synchronously, under the lock)
+  write_record_ret
+  write_evicted_record_at(tid_t t, const void *v, tuple_writer_t writer);
+
+  /**
+   * Appends the value of base (which should be locked) to the evict_store,
+   * returning a stub to replace it with, or nullptr if there is no
+   * evict_store
+   */
+  static dbtuple *alloc_evicted(const dbtuple *base);
+
+  /**
+   * Reads the value of stub (which should be locked) back in from the
+   * evict_store, returning a regular tuple to replace it with
+   */
+  static dbtuple *alloc_resident(const dbtuple *stub);
+#endif
+
   // NB: we round up allocation sizes because jemalloc will do this
   // internally anyways, so we might as well grab more usable space (really
   // just internal vs external fragmentation)
@@ -1016,7 +1243,7 @@ public:
       std::min(
           util::round_up<size_t, allocator::LgAllocAlignment>(sizeof(dbtuple) + base->size),
           max_alloc_sz);
-    char *p = reinterpret_cast<char *>(rcu::s_instance.alloc(alloc_sz));
+    char *p = reinterpret_cast<char *>(rcu::s_instance.alloc_near(base, alloc_sz));
     INVARIANT(p);
     return new (p) dbtuple(
         version, base, alloc_sz - sizeof(dbtuple), set_latest);
@@ -1038,7 +1265,8 @@ public:
       std::min(
           util::round_up<size_t, allocator::LgAllocAlignment>(sizeof(dbtuple) + needed_sz),
           max_alloc_sz);
-    char *p = reinterpret_cast<char *>(rcu::s_instance.alloc(alloc_sz));
+    // a spill is the next version of next, so keep it in next's region
+    char *p = reinterpret_cast<char *>(rcu::s_instance.alloc_near(next, alloc_sz));
     INVARIANT(p);
     return new (p) dbtuple(
         version, value, oldsz, newsz,
@@ -1085,6 +1313,83 @@ public:
     destruct_and_free(n);
   }
 
+  // the alloc_size which alloc() would pick for a record of sz bytes
+  static inline size_type
+  compacted_alloc_size(size_type sz)
+  {
+    const size_t max_alloc_sz =
+      std::numeric_limits<node_size_type>::max() + sizeof(dbtuple);
+    return std::min(
+        util::round_up<size_t, allocator::LgAllocAlignment>(sizeof(dbtuple) + sz),
+        max_alloc_sz) - sizeof(dbtuple);
+  }
+
+  /**
+   * Is this tuple worth re-packing into a right-sized allocation? Only the
+   * latest, non-deleted version of a committed record qualifies- deleted
+   * records are already owned by the GC queue. Caller should hold the lock
+   * for a stable answer
+   */
+  inline bool
+  is_compaction_candidate(size_type min_slack_bytes) const
+  {
+    if (!is_latest() || is_deleting() || is_compressed() || is_evicted() ||
+        version == MAX_TID)
+      return false;
+    const size_type want = compacted_alloc_size(size);
+    return alloc_size > want && (alloc_size - want) >= min_slack_bytes;
+  }
+
+  /**
+   * Is this the latest version of a committed delete (as opposed to the
+   * placeholder of an insert which is still in flight)? Caller should hold
+   * the lock for a stable answer
+   */
+  inline bool
+  is_tombstone() const
+  {
+    return is_latest() && is_deleting() && version != MAX_TID;
+  }
+
+#ifdef TUPLE_COLD_COMPRESSION
+  inline bool
+  is_cold_compression_candidate(uint8_t min_idle_ticks) const
+  {
+    // tiny records are not worth the trouble
+    static const size_type MinCompressSize = 64;
+    return is_latest() && !is_deleting() && !is_compressed() &&
+           !is_evicted() && version != MAX_TID && size >= MinCompressSize &&
+           idle_ticks() >= min_idle_ticks;
+  }
+#endif
+
+#ifdef TUPLE_ANTI_CACHING
+  // XXX: compressed tuples are never evicted, so a table should not enable
+  // both with the same threshold
+  inline bool
+  is_eviction_candidate(uint8_t min_idle_ticks) const
+  {
+    // a stub is still a dbtuple + an offset, so only evict records which
+    // are a good deal larger than that
+    static const size_type MinEvictSize = 64;
+    return is_latest() && !is_deleting() && !is_compressed() &&
+           !is_evicted() && version != MAX_TID && size >= MinEvictSize &&
+           idle_ticks() >= min_idle_ticks;
+  }
+#endif
+
+  static event_counter g_evt_dbtuple_compactions;
+  static event_counter g_evt_dbtuple_compaction_bytes_reclaimed;
+  static event_counter g_evt_dbtuple_cold_compressions;
+  static event_counter g_evt_dbtuple_cold_compression_bytes_saved;
+  static event_counter g_evt_dbtuple_cold_reads;
+  static event_counter g_evt_dbtuple_cold_inflations;
+  static event_counter g_evt_dbtuple_evictions;
+  static event_counter g_evt_dbtuple_eviction_bytes_saved;
+  static event_counter g_evt_dbtuple_fault_ins;
+  static event_counter g_evt_dbtuple_migrations;
+  static event_counter g_evt_dbtuple_tombstone_purges;
+
   static std::string
   VersionInfoStr(version_t v);
 
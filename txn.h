@@ -35,6 +35,7 @@
 #include "tuple.h"
 #include "scopedperf.hh"
 #include "marked_ptr.h"
+#include "conflict_sampler.h"
 
 // forward decl
 template <template <typename> class Transaction, typename P>
@@ -83,7 +84,8 @@ public:
     x(ABORT_REASON_WRITE_NODE_INTERFERENCE) \
     x(ABORT_REASON_INSERT_NODE_INTERFERENCE) \
     x(ABORT_REASON_READ_NODE_INTEREFERENCE) \
-    x(ABORT_REASON_READ_ABSENCE_INTEREFERENCE)
+    x(ABORT_REASON_READ_ABSENCE_INTEREFERENCE) \
+    x(ABORT_REASON_EVICTED_READ)
 
   enum abort_reason {
 #define ENUM_X(x) x,
@@ -708,6 +710,20 @@ protected:
   void
   do_node_read(const typename concurrent_btree::node_opaque_t *n, uint64_t version);
 
+  // remembers where tuple was read from, so that a read validation failure
+  // on it can be handed to the conflict_sampler. the key is copied- callers'
+  // key buffers are typically reused for the next lookup
+  inline void
+  note_read_key(const dbtuple *tuple, const concurrent_btree *btr,
+                const char *key, size_t keylen)
+  {
+    if (likely(!conflict_sampler::g_enabled) || is_snapshot())
+      return;
+    std::string * const px = string_allocator()();
+    px->assign(key, keylen);
+    read_keys.emplace_back(tuple, btr, px);
+  }
+
 public:
   // expected public overrides
 
@@ -799,10 +815,18 @@ protected:
   handle_last_tuple_in_group(
       dbtuple_write_info &info, bool did_group_insert);
 
+  // hands tuple's (table, key) to the conflict_sampler
+  void sample_read_conflict(const dbtuple *tuple);
+
   read_set_map read_set;
   write_set_map write_set;
   absent_set_map absent_set;
 
+  // (tuple, btree, key), only while conflict_sampler::g_enabled
+  typedef std::tuple<const dbtuple *, const concurrent_btree *,
+                     const std::string *> read_key_t;
+  std::vector<read_key_t> read_keys;
+
   string_allocator_type *sa;
 
   unmanaged<scoped_rcu_region> rcu_guard_;
@@ -8,10 +8,12 @@
 #include "txn_proto2_impl.h"
 #include "txn_btree.h"
 #include "typed_txn_btree.h"
+#include "indexed_txn_btree.h"
 #include "thread.h"
 #include "util.h"
 #include "macros.h"
 #include "tuple.h"
+#include "evict_store.h"
 #include "record/encoder.h"
 #include "record/inline_str.h"
 
@@ -306,6 +308,351 @@ test_inc_value_size()
   }
 }
 
+template <template <typename> class TxnType, typename Traits>
+static void
+test_compaction()
+{
+  for (size_t txn_flags_idx = 0;
+       txn_flags_idx < ARRAY_NELEMS(TxnFlags);
+       txn_flags_idx++) {
+    const uint64_t txn_flags = TxnFlags[txn_flags_idx];
+    txn_btree<TxnType> btr;
+    typename Traits::StringAllocator arena;
+    const size_t nkeys = 100;
+    for (size_t i = 0; i < nkeys; i++) {
+      // grow the record well past its initial allocation...
+      const string big(1024, 'a');
+      TxnType<Traits> t0(txn_flags, arena);
+      btr.insert_object(t0, u64_varkey(i), rec(i));
+      AssertSuccessfulCommit(t0);
+      TxnType<Traits> t1(txn_flags, arena);
+      btr.insert(t1, u64_varkey(i), (const uint8_t *) big.data(), big.size());
+      AssertSuccessfulCommit(t1);
+      // ...then shrink it back down, which happens in place
+      TxnType<Traits> t2(txn_flags, arena);
+      btr.insert_object(t2, u64_varkey(i), rec(i + 1));
+      AssertSuccessfulCommit(t2);
+    }
+
+    ALWAYS_ASSERT(btr.compact() > 0);
+    // nothing left to do on the second pass
+    ALWAYS_ASSERT(btr.compact() == 0);
+
+    for (size_t i = 0; i < nkeys; i++) {
+      TxnType<Traits> t(txn_flags, arena);
+      string v;
+      ALWAYS_ASSERT_COND_IN_TXN(t, btr.search(t, u64_varkey(i), v));
+      AssertByteEquality(rec(i + 1), v);
+      // and the compacted tuple must still be writable
+      btr.insert_object(t, u64_varkey(i), rec(i + 2));
+      AssertSuccessfulCommit(t);
+    }
+
+#ifdef TUPLE_COLD_COMPRESSION
+    // a compressible value, left untouched for a few ticks, should be
+    // compressed, and still be readable + writable afterwards
+    const string cold(512, 'b');
+    for (size_t i = 0; i < nkeys; i++) {
+      TxnType<Traits> t(txn_flags, arena);
+      btr.insert(t, u64_varkey(i), (const uint8_t *) cold.data(), cold.size());
+      AssertSuccessfulCommit(t);
+    }
+    btr.set_cold_compression(1);
+    usleep(200000);
+    ALWAYS_ASSERT(btr.compress_cold() > 0);
+    ALWAYS_ASSERT(btr.compress_cold() == 0);
+    for (size_t i = 0; i < nkeys; i++) {
+      TxnType<Traits> t(txn_flags, arena);
+      string v;
+      ALWAYS_ASSERT_COND_IN_TXN(t, btr.search(t, u64_varkey(i), v));
+      ALWAYS_ASSERT_COND_IN_TXN(t, v == cold);
+      btr.insert_object(t, u64_varkey(i), rec(i + 3));
+      AssertSuccessfulCommit(t);
+    }
+#endif
+
+#ifdef TUPLE_ANTI_CACHING
+    if (!evict_store::s_instance.is_open())
+      evict_store::s_instance.open("/tmp/silo-txn-btree-evict-test");
+    const string evictee(256, 'c');
+    for (size_t i = 0; i < nkeys; i++) {
+      TxnType<Traits> t(txn_flags, arena);
+      btr.insert(t, u64_varkey(i), (const uint8_t *) evictee.data(), evictee.size());
+      AssertSuccessfulCommit(t);
+    }
+    btr.set_eviction(1);
+    usleep(200000);
+    ALWAYS_ASSERT(btr.evict_cold() > 0);
+    ALWAYS_ASSERT(btr.evict_cold() == 0);
+    btr.set_eviction(0);
+    for (size_t i = 0; i < nkeys; i++) {
+      // the first read faults the record in and aborts...
+      {
+        TxnType<Traits> t(txn_flags, arena);
+        string v;
+        try {
+          btr.search(t, u64_varkey(i), v);
+          ALWAYS_ASSERT(false);
+        } catch (transaction_abort_exception &e) {
+          ALWAYS_ASSERT(e.get_reason() == transaction_base::ABORT_REASON_EVICTED_READ);
+        }
+      }
+      // ...and the retry finds it resident
+      TxnType<Traits> t(txn_flags, arena);
+      string v;
+      ALWAYS_ASSERT_COND_IN_TXN(t, btr.search(t, u64_varkey(i), v));
+      ALWAYS_ASSERT_COND_IN_TXN(t, v == evictee);
+      AssertSuccessfulCommit(t);
+    }
+#endif
+
+    txn_epoch_sync<TxnType>::sync();
+    txn_epoch_sync<TxnType>::finish();
+  }
+}
+
+template <template <typename> class TxnType, typename Traits>
+static void
+test_bulk_load()
+{
+  for (size_t txn_flags_idx = 0;
+       txn_flags_idx < ARRAY_NELEMS(TxnFlags);
+       txn_flags_idx++) {
+    const uint64_t txn_flags = TxnFlags[txn_flags_idx];
+    txn_btree<TxnType> btr;
+    typename Traits::StringAllocator arena;
+    const size_t nkeys = 5000;
+    vector<pair<string, string>> records;
+    for (size_t i = 0; i < nkeys; i++)
+      records.emplace_back(u64_varkey(i).str(), string(1 + (i % 64), 'a'));
+    ALWAYS_ASSERT(btr.bulk_load(records.begin(), records.end()) == nkeys);
+    // existing keys are left alone
+    ALWAYS_ASSERT(btr.bulk_load(records.begin(), records.begin() + 10) == 0);
+    ALWAYS_ASSERT(btr.size_estimate() == nkeys);
+    ALWAYS_ASSERT(btr.size_exact() == nkeys);
+
+    for (size_t i = 0; i < nkeys; i++) {
+      TxnType<Traits> t(txn_flags, arena);
+      string v;
+      ALWAYS_ASSERT_COND_IN_TXN(t, btr.search(t, u64_varkey(i), v));
+      ALWAYS_ASSERT_COND_IN_TXN(t, v == records[i].second);
+      // loaded records are regular records otherwise
+      btr.insert_object(t, u64_varkey(i), rec(i));
+      AssertSuccessfulCommit(t);
+    }
+
+    txn_epoch_sync<TxnType>::sync();
+    txn_epoch_sync<TxnType>::finish();
+  }
+}
+
+template <template <typename> class TxnType, typename Traits>
+static void
+test_point_index()
+{
+  for (size_t txn_flags_idx = 0;
+       txn_flags_idx < ARRAY_NELEMS(TxnFlags);
+       txn_flags_idx++) {
+    const uint64_t txn_flags = TxnFlags[txn_flags_idx];
+    txn_btree<TxnType> btr;
+    typename Traits::StringAllocator arena;
+    const size_t nkeys = 1000;
+    for (size_t i = 0; i < nkeys / 2; i++) {
+      TxnType<Traits> t(txn_flags, arena);
+      btr.insert_object(t, u64_varkey(i), rec(i));
+      AssertSuccessfulCommit(t);
+    }
+    // picks up the keys already there, and the ones inserted from now on
+    btr.enable_point_index();
+    for (size_t i = nkeys / 2; i < nkeys; i++) {
+      TxnType<Traits> t(txn_flags, arena);
+      btr.insert_object(t, u64_varkey(i), rec(i));
+      AssertSuccessfulCommit(t);
+    }
+    for (size_t i = 0; i < nkeys; i += 2) {
+      TxnType<Traits> t(txn_flags, arena);
+      btr.remove(t, u64_varkey(i));
+      AssertSuccessfulCommit(t);
+    }
+    txn_epoch_sync<TxnType>::sync();
+    for (size_t i = 0; i < nkeys; i++) {
+      TxnType<Traits> t(txn_flags, arena);
+      string v;
+      const bool found = btr.search(t, u64_varkey(i), v);
+      ALWAYS_ASSERT_COND_IN_TXN(t, found == bool(i % 2));
+      if (found)
+        AssertByteEquality(rec(i), v);
+      AssertSuccessfulCommit(t);
+    }
+    txn_epoch_sync<TxnType>::sync();
+    txn_epoch_sync<TxnType>::finish();
+  }
+}
+
+template <template <typename> class TxnType, typename Traits>
+static void
+test_leaf_cache()
+{
+  txn_btree<TxnType> btr;
+  btr.enable_leaf_cache();
+  typename Traits::StringAllocator arena;
+  const size_t nkeys = 200;
+  for (size_t i = 0; i < nkeys; i++) {
+    TxnType<Traits> t(0, arena);
+    btr.insert_object(t, u64_varkey(i), rec(i));
+    AssertSuccessfulCommit(t);
+  }
+  uint64_t hits, misses, hits0, misses0;
+  for (size_t round = 0; round < 3; round++) {
+    // the first lookup of each key fills the cache (overwrites do not
+    // touch the leaf, so it may hit too), the rest must hit it
+    for (size_t i = 0; i < nkeys; i++) {
+      for (size_t j = 0; j < 3; j++) {
+        TxnType<Traits> t(0, arena);
+        string v;
+        btr.leaf_cache_stats(hits0, misses0);
+        ALWAYS_ASSERT_COND_IN_TXN(t, btr.search(t, u64_varkey(i), v));
+        btr.leaf_cache_stats(hits, misses);
+        ALWAYS_ASSERT_COND_IN_TXN(t, hits + misses == hits0 + misses0 + 1);
+        if (j)
+          ALWAYS_ASSERT_COND_IN_TXN(t, hits == hits0 + 1);
+        AssertByteEquality(rec(i + round), v);
+        AssertSuccessfulCommit(t);
+      }
+      TxnType<Traits> t(0, arena);
+      btr.insert_object(t, u64_varkey(i), rec(i + round + 1));
+      AssertSuccessfulCommit(t);
+    }
+  }
+
+  // each new key lands right before (and eventually splits) w's leaf,
+  // which must invalidate w's entry
+  const size_t w = 4 * nkeys;
+  {
+    TxnType<Traits> t(0, arena);
+    btr.insert_object(t, u64_varkey(w), rec(w));
+    AssertSuccessfulCommit(t);
+  }
+  for (size_t i = nkeys; i < 2 * nkeys; i++) {
+    {
+      TxnType<Traits> t(0, arena);
+      string v;
+      ALWAYS_ASSERT_COND_IN_TXN(t, btr.search(t, u64_varkey(w), v));
+      AssertSuccessfulCommit(t);
+    }
+    {
+      TxnType<Traits> t(0, arena);
+      btr.insert_object(t, u64_varkey(i), rec(i));
+      AssertSuccessfulCommit(t);
+    }
+    TxnType<Traits> t(0, arena);
+    string v;
+    btr.leaf_cache_stats(hits0, misses0);
+    ALWAYS_ASSERT_COND_IN_TXN(t, btr.search(t, u64_varkey(w), v));
+    btr.leaf_cache_stats(hits, misses);
+    ALWAYS_ASSERT_COND_IN_TXN(t, misses == misses0 + 1);
+    AssertByteEquality(rec(w), v);
+    AssertSuccessfulCommit(t);
+  }
+  txn_epoch_sync<TxnType>::sync();
+  txn_epoch_sync<TxnType>::finish();
+}
+
+template <template <typename> class TxnType, typename Traits>
+static void
+test_purge_tombstones()
+{
+  txn_btree<TxnType> btr;
+  typename Traits::StringAllocator arena;
+  const size_t nkeys = 2000;
+  for (size_t i = 0; i < nkeys; i++) {
+    TxnType<Traits> t(0, arena);
+    btr.insert_object(t, u64_varkey(i), rec(i));
+    AssertSuccessfulCommit(t);
+  }
+  for (size_t i = 0; i < nkeys; i += 2) {
+    TxnType<Traits> t(0, arena);
+    btr.remove(t, u64_varkey(i));
+    AssertSuccessfulCommit(t);
+  }
+  // wait until no snapshot can see the deleted records anymore
+  for (size_t i = 0; i < 3; i++)
+    txn_epoch_sync<TxnType>::sync();
+  // our own GC may well have beaten us to some of them
+  btr.purge_tombstones();
+  ALWAYS_ASSERT(btr.size_exact() == nkeys / 2);
+  ALWAYS_ASSERT(btr.purge_tombstones() == 0);
+  for (size_t i = 0; i < nkeys; i++) {
+    TxnType<Traits> t(0, arena);
+    string v;
+    const bool found = btr.search(t, u64_varkey(i), v);
+    ALWAYS_ASSERT_COND_IN_TXN(t, found == bool(i % 2));
+    if (found)
+      AssertByteEquality(rec(i), v);
+    else
+      btr.insert_object(t, u64_varkey(i), rec(i + 1));
+    AssertSuccessfulCommit(t);
+  }
+  ALWAYS_ASSERT(btr.size_exact() == nkeys);
+  txn_epoch_sync<TxnType>::sync();
+  txn_epoch_sync<TxnType>::finish();
+}
+
+template <template <typename> class Protocol>
+class key_collecting_callback : public txn_btree<Protocol>::search_range_callback {
+public:
+  virtual bool
+  invoke(const typename txn_btree<Protocol>::keystring_type &k, const string &v)
+  {
+    ALWAYS_ASSERT(keys.empty() || keys.back() < string(k.data(), k.size()));
+    keys.emplace_back(k.data(), k.size());
+    return true;
+  }
+  vector<string> keys;
+};
+
+template <template <typename> class TxnType, typename Traits>
+static void
+test_parallel_scan()
+{
+  txn_btree<TxnType> btr;
+  typename Traits::StringAllocator arena;
+  const size_t nkeys = 20000;
+  vector<pair<string, string>> records;
+  for (size_t i = 0; i < nkeys; i++)
+    records.emplace_back(u64_varkey(i).str(), string(8, 'a'));
+  ALWAYS_ASSERT(btr.bulk_load(records.begin(), records.end()) == nkeys);
+  txn_epoch_sync<TxnType>::sync();
+
+  const size_t nparts = 4;
+  // fewer pool threads than parts- the rest have to queue up
+  const size_t max_threads = worker_pool::s_instance.max_threads();
+  worker_pool::s_instance.set_max_threads(2);
+  const string lower = u64_varkey(100).str();
+  const string upper = u64_varkey(nkeys - 100).str();
+  for (const string *u : {&upper, (const string *) nullptr}) {
+    vector<key_collecting_callback<TxnType>> cbs(nparts);
+    vector<typename txn_btree<TxnType>::search_range_callback *> pcbs;
+    for (auto &cb : cbs)
+      pcbs.push_back(&cb);
+    TxnType<Traits> t(transaction_base::TXN_FLAG_READ_ONLY, arena);
+    const size_t n = btr.parallel_search_range_call(t, lower, u, pcbs);
+    ALWAYS_ASSERT(n >= 1 && n <= nparts);
+    // the parts must stitch back together into the serial scan
+    vector<string> keys;
+    for (auto &cb : cbs)
+      keys.insert(keys.end(), cb.keys.begin(), cb.keys.end());
+    ALWAYS_ASSERT(keys.size() == (u ? nkeys - 200 : nkeys - 100));
+    for (size_t i = 0; i < keys.size(); i++)
+      ALWAYS_ASSERT(keys[i] == records[100 + i].first);
+    AssertSuccessfulCommit(t);
+  }
+  worker_pool::s_instance.set_max_threads(max_threads);
+
+  txn_epoch_sync<TxnType>::sync();
+  txn_epoch_sync<TxnType>::finish();
+}
+
 template <template <typename> class TxnType, typename Traits>
 static void
 test_multi_btree()
@@ -687,6 +1034,149 @@ test_typed_btree()
   cerr << "test_typed_btree() passed" << endl;
 }
 
+// testrec by v1, covering v2 (int32_t so that keys sort by v1)
+#define TESTREC_V1_IDX_KEY_FIELDS(x, y) \
+  x(int32_t,v1) \
+  y(int32_t,k0) \
+  y(int32_t,k1)
+#define TESTREC_V1_IDX_VALUE_FIELDS(x, y) \
+  x(inline_str_fixed<10>,v2)
+DO_STRUCT(testrec_v1_idx, TESTREC_V1_IDX_KEY_FIELDS, TESTREC_V1_IDX_VALUE_FIELDS)
+
+namespace test_indexed_btree_ns {
+
+struct v1_extractor {
+  inline bool
+  operator()(const testrec::key &k, const testrec::value &v,
+             testrec_v1_idx::key &ik, testrec_v1_idx::value &iv) const
+  {
+    // records w/ a negative v1 are not indexed
+    if (v.v1 < 0)
+      return false;
+    ik.v1 = v.v1;
+    ik.k0 = k.k0;
+    ik.k1 = k.k1;
+    iv.v2 = v.v2;
+    return true;
+  }
+};
+
+template <template <typename> class Protocol>
+class v1_idx_scan_callback : public typed_txn_btree<Protocol, schema<testrec_v1_idx>>::search_range_callback {
+public:
+  virtual bool
+  invoke(const testrec_v1_idx::key &key,
+         const testrec_v1_idx::value &value)
+  {
+    entries.emplace_back(key, value);
+    return true;
+  }
+  vector<pair<testrec_v1_idx::key, testrec_v1_idx::value>> entries;
+};
+
+}
+
+template <template <typename> class TxnType, typename Traits>
+static void
+test_indexed_btree()
+{
+  using namespace test_indexed_btree_ns;
+
+  typedef typed_secondary_index<
+    TxnType, schema<testrec>, schema<testrec_v1_idx>, v1_extractor> v1_idx_type;
+  indexed_txn_btree<TxnType, schema<testrec>, v1_idx_type> btr;
+  v1_idx_type &idx = btr.template index<0>();
+  typename Traits::StringAllocator arena;
+  typedef TxnType<Traits> txn_type;
+
+  const size_t nrecs = 10;
+  {
+    txn_type t(0, arena);
+    for (size_t i = 0; i < nrecs; i++)
+      btr.insert(t, testrec::key(1, i), testrec::value(i, i % 2, "A"));
+    AssertSuccessfulCommit(t);
+  }
+
+  // the v1=1 records, answered from the index alone
+  {
+    txn_type t(0, arena);
+    const testrec_v1_idx::key lower(1, 0, 0), upper(2, 0, 0);
+    v1_idx_scan_callback<TxnType> cb;
+    idx.search_range_call(t, lower, &upper, cb);
+    ALWAYS_ASSERT_COND_IN_TXN(t, cb.entries.size() == nrecs / 2);
+    for (auto &e : cb.entries) {
+      ALWAYS_ASSERT_COND_IN_TXN(t, e.first.k1 % 2 == 1);
+      ALWAYS_ASSERT_COND_IN_TXN(t, e.second.v2 == testrec::value(0, 0, "A").v2);
+    }
+    AssertSuccessfulCommit(t);
+  }
+
+  // moving the indexed field moves the entry, changing a covered one
+  // rewrites it in place
+  {
+    txn_type t(0, arena);
+    btr.put(t, testrec::key(1, 0), testrec::value(0, 7, ""), FIELDS(1));
+    btr.put(t, testrec::key(1, 1), testrec::value(0, 0, "B"), FIELDS(2));
+    AssertSuccessfulCommit(t);
+  }
+  {
+    txn_type t(0, arena);
+    testrec_v1_idx::value iv;
+    ALWAYS_ASSERT_COND_IN_TXN(t, !idx.search(t, testrec_v1_idx::key(0, 1, 0), iv));
+    ALWAYS_ASSERT_COND_IN_TXN(t, idx.search(t, testrec_v1_idx::key(7, 1, 0), iv));
+    ALWAYS_ASSERT_COND_IN_TXN(t, iv.v2 == testrec::value(0, 0, "A").v2);
+    ALWAYS_ASSERT_COND_IN_TXN(t, idx.search(t, testrec_v1_idx::key(1, 1, 1), iv));
+    ALWAYS_ASSERT_COND_IN_TXN(t, iv.v2 == testrec::value(0, 0, "B").v2);
+    AssertSuccessfulCommit(t);
+  }
+
+  // unindexed records, removes, and aborts
+  {
+    txn_type t(0, arena);
+    btr.insert(t, testrec::key(2, 0), testrec::value(0, -1, "C"));
+    btr.remove(t, testrec::key(1, 2));
+    AssertSuccessfulCommit(t);
+  }
+  {
+    txn_type t(0, arena);
+    btr.insert(t, testrec::key(2, 1), testrec::value(0, 5, "D"));
+    t.abort();
+  }
+
+  // an insert over an existing record moves its entry, like a put
+  {
+    txn_type t(0, arena);
+    btr.insert(t, testrec::key(1, 3), testrec::value(0, 4, "E"));
+    AssertSuccessfulCommit(t);
+  }
+  {
+    txn_type t(0, arena);
+    testrec_v1_idx::value iv;
+    ALWAYS_ASSERT_COND_IN_TXN(t, !idx.search(t, testrec_v1_idx::key(1, 1, 3), iv));
+    ALWAYS_ASSERT_COND_IN_TXN(t, idx.search(t, testrec_v1_idx::key(4, 1, 3), iv));
+    ALWAYS_ASSERT_COND_IN_TXN(t, iv.v2 == testrec::value(0, 0, "E").v2);
+    AssertSuccessfulCommit(t);
+  }
+  {
+    txn_type t(0, arena);
+    const testrec_v1_idx::key lower(0, 0, 0);
+    v1_idx_scan_callback<TxnType> cb;
+    idx.search_range_call(t, lower, nullptr, cb);
+    // 10 - (1, 2)
+    ALWAYS_ASSERT_COND_IN_TXN(t, cb.entries.size() == nrecs - 1);
+    for (auto &e : cb.entries) {
+      ALWAYS_ASSERT_COND_IN_TXN(t, e.first.k0 == 1);
+      ALWAYS_ASSERT_COND_IN_TXN(t, e.first.k1 != 2);
+    }
+    AssertSuccessfulCommit(t);
+  }
+
+  txn_epoch_sync<TxnType>::sync();
+  txn_epoch_sync<TxnType>::finish();
+
+  cerr << "test_indexed_btree() passed" << endl;
+}
+
 template <template <typename> class Protocol>
 class txn_btree_worker : public ndb_thread {
 public:
@@ -1881,10 +2371,17 @@ void txn_btree_test()
 {
   cerr << "Test proto2" << endl;
   test_typed_btree<transaction_proto2, default_stable_transaction_traits>();
+  test_indexed_btree<transaction_proto2, default_stable_transaction_traits>();
   test1<transaction_proto2, default_transaction_traits>();
   test2<transaction_proto2, default_transaction_traits>();
   test_absent_key_race<transaction_proto2, default_transaction_traits>();
   test_inc_value_size<transaction_proto2, default_transaction_traits>();
+  test_compaction<transaction_proto2, default_transaction_traits>();
+  test_bulk_load<transaction_proto2, default_transaction_traits>();
+  test_parallel_scan<transaction_proto2, default_transaction_traits>();
+  test_point_index<transaction_proto2, default_transaction_traits>();
+  test_leaf_cache<transaction_proto2, default_transaction_traits>();
+  test_purge_tombstones<transaction_proto2, default_transaction_traits>();
   test_multi_btree<transaction_proto2, default_transaction_traits>();
   test_read_only_snapshot<transaction_proto2, default_transaction_traits>();
   test_long_keys<transaction_proto2, default_transaction_traits>();
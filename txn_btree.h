@@ -1,7 +1,11 @@
 #ifndef _NDB_TXN_BTREE_H_
 #define _NDB_TXN_BTREE_H_
 
+#include <functional>
+#include <vector>
+
 #include "base_txn_btree.h"
+#include "worker_pool.h"
 
 // XXX: hacky
 extern void txn_btree_test();
@@ -322,6 +326,58 @@ public:
     this->do_search_range_call(t, lower, upper, callback, kr, vr);
   }
 
+  /**
+   * Splits [lower, upper) into up to callbacks.size() consecutive parts
+   * and scans them concurrently on the worker pool. Part i is fed, in key
+   * order, to callbacks[i]; returns the number of parts used, so the
+   * callbacks past that see nothing. Merging the parts is up to the caller.
+   * At most worker_pool::max_threads() parts run at once, and each pool
+   * thread takes a core id for good (see worker_pool).
+   *
+   * t must be a read-only (snapshot) txn- each part runs in its own txn
+   * at t's snapshot, which t keeps from being reclaimed. Throws
+   * transaction_abort_exception if any part aborts
+   */
+  template <typename Traits>
+  size_t
+  parallel_search_range_call(Transaction<Traits> &t,
+                             const key_type &lower,
+                             const key_type *upper,
+                             const std::vector<search_range_callback *> &callbacks,
+                             size_type max_bytes_read = string_type::npos)
+  {
+    ALWAYS_ASSERT(t.is_snapshot());
+    ALWAYS_ASSERT(!callbacks.empty());
+    const std::vector<std::string> bounds =
+      this->split_range(lower, upper, callbacks.size());
+    std::vector<transaction_base::abort_reason> reasons(
+        bounds.size(), transaction_base::ABORT_REASON_NONE);
+    std::vector<std::function<void()>> tasks;
+    for (size_t i = 0; i < bounds.size(); i++)
+      tasks.emplace_back([&, i]() {
+        typename Traits::StringAllocator sa;
+        Transaction<Traits> pt(t.get_flags(), sa);
+        pt.adopt_snapshot(t);
+        try {
+          key_reader_type kr;
+          value_reader_type vr(max_bytes_read);
+          this->do_search_range_call(
+              pt, bounds[i],
+              (i + 1) < bounds.size() ? &bounds[i + 1] : upper,
+              *callbacks[i], kr, vr);
+          pt.commit(true);
+        } catch (transaction_abort_exception &ex) {
+          // pt has already been aborted
+          reasons[i] = ex.get_reason();
+        }
+      });
+    worker_pool::s_instance.run(tasks);
+    for (auto r : reasons)
+      if (r != transaction_base::ABORT_REASON_NONE)
+        throw transaction_abort_exception(r);
+    return bounds.size();
+  }
+
   template <typename Traits>
   inline void
   rsearch_range_call(Transaction<Traits> &t,
@@ -3,6 +3,7 @@
 
 #include "txn.h"
 #include "lockguard.h"
+#include "commit_trace.h"
 
 // base definitions
 
@@ -253,6 +254,8 @@ transaction<Protocol, Traits>::commit(bool doThrow)
     return false;
   }
 
+  commit_trace::record * const trace =
+    commit_trace::begin(read_set.size(), write_set.size());
   dbtuple_write_info_vec write_dbtuples;
   std::pair<bool, tid_t> commit_tid(false, 0);
 
@@ -300,6 +303,8 @@ transaction<Protocol, Traits>::commit(bool doThrow)
         if (likely(last_px && last_px->tuple != it->tuple)) {
           // on boundary
           if (unlikely(!handle_last_tuple_in_group(*last_px, inserted_last_run))) {
+            conflict_sampler::offer(last_px->entry->get_btree(),
+                                    last_px->entry->get_key());
             abort_trap((reason = ABORT_REASON_WRITE_NODE_INTERFERENCE));
             goto do_abort;
           }
@@ -318,15 +323,19 @@ transaction<Protocol, Traits>::commit(bool doThrow)
       }
       if (likely(last_px) &&
           unlikely(!handle_last_tuple_in_group(*last_px, inserted_last_run))) {
+        conflict_sampler::offer(last_px->entry->get_btree(),
+                                last_px->entry->get_key());
         abort_trap((reason = ABORT_REASON_WRITE_NODE_INTERFERENCE));
         goto do_abort;
       }
       commit_tid.first = true;
+      commit_trace::mark(trace, commit_trace::PHASE_LOCKED);
       PERF_DECL(
           static std::string probe5_name(
             std::string(__PRETTY_FUNCTION__) + std::string(":gen_commit_tid:")));
       ANON_REGION(probe5_name.c_str(), &transaction_base::g_txn_commit_probe5_cg);
       commit_tid.second = cast()->gen_commit_tid(write_dbtuples);
+      commit_trace::mark(trace, commit_trace::PHASE_TID);
       VERBOSE(std::cerr << "commit tid: " << g_proto_version_str(commit_tid.second) << std::endl);
     } else {
       VERBOSE(std::cerr << "commit tid: <read-only>" << std::endl);
@@ -362,6 +371,8 @@ transaction<Protocol, Traits>::commit(bool doThrow)
 
           //std::cerr << "failed tuple: " << *it->get_tuple() << std::endl;
 
+          if (unlikely(conflict_sampler::g_enabled))
+            sample_read_conflict(it->get_tuple());
           abort_trap((reason = ABORT_REASON_READ_NODE_INTEREFERENCE));
           goto do_abort;
         }
@@ -376,12 +387,15 @@ transaction<Protocol, Traits>::commit(bool doThrow)
           if (unlikely(v != it->second.version)) {
             VERBOSE(std::cerr << "expected node " << util::hexify(it->first) << " at v="
                               << it->second.version << ", got v=" << v << std::endl);
+            // a node, not a key- count it, but there is nothing to name
+            conflict_sampler::offer_unattributed();
             abort_trap((reason = ABORT_REASON_NODE_SCAN_READ_VERSION_CHANGED));
             goto do_abort;
           }
         }
       }
     }
+    commit_trace::mark(trace, commit_trace::PHASE_VALIDATED);
 
     // commit actual records
     if (!write_dbtuples.empty()) {
@@ -448,11 +462,14 @@ transaction<Protocol, Traits>::commit(bool doThrow)
         else
           INVARIANT(!it->is_insert());
       }
+      commit_trace::mark(trace, commit_trace::PHASE_WRITTEN);
     }
   }
   state = TXN_COMMITED;
   if (commit_tid.first)
     cast()->on_tid_finish(commit_tid.second);
+  commit_trace::end(
+      trace, true, commit_tid.first ? commit_tid.second : 0);
   clear();
   return true;
 
@@ -482,6 +499,7 @@ do_abort:
   state = TXN_ABRT;
   if (commit_tid.first)
     cast()->on_tid_finish(commit_tid.second);
+  commit_trace::end(trace, false, 0);
   clear();
   if (doThrow)
     throw transaction_abort_exception(reason);
@@ -603,6 +621,12 @@ transaction<Protocol, Traits>::do_tuple_read(
       abort_impl(r);
       throw transaction_abort_exception(r);
     }
+    if (unlikely(stat == dbtuple::READ_EVICTED)) {
+      // raced with the evictor- the retry will fault the record in
+      const transaction_base::abort_reason r = transaction_base::ABORT_REASON_EVICTED_READ;
+      abort_impl(r);
+      throw transaction_abort_exception(r);
+    }
   }
   if (unlikely(!cast()->can_read_tid(start_t))) {
     const transaction_base::abort_reason r = transaction_base::ABORT_REASON_FUTURE_TID_READ;
@@ -621,6 +645,26 @@ transaction<Protocol, Traits>::do_tuple_read(
   return !v_empty;
 }
 
+template <template <typename> class Protocol, typename Traits>
+void
+transaction<Protocol, Traits>::sample_read_conflict(const dbtuple *tuple)
+{
+  // written by us too? then the write set knows the key
+  auto wit = find_write_set(const_cast<dbtuple *>(tuple));
+  if (wit != write_set.end()) {
+    conflict_sampler::offer(wit->get_btree(), wit->get_key());
+    return;
+  }
+  for (auto &r : read_keys) {
+    if (std::get<0>(r) == tuple) {
+      conflict_sampler::offer(std::get<1>(r), *std::get<2>(r));
+      return;
+    }
+  }
+  // the read happened before sampling was enabled
+  conflict_sampler::offer_unattributed();
+}
+
 template <template <typename> class Protocol, typename Traits>
 void
 transaction<Protocol, Traits>::do_node_read(
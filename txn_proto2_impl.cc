@@ -40,16 +40,16 @@ event_counter
   txn_logger::g_evt_logger_writev_limit_met("logger_writev_limit_met");
 event_counter
   txn_logger::g_evt_logger_max_lag_wait("logger_max_lag_wait");
-event_avg_counter
+event_hist_counter
   txn_logger::g_evt_avg_log_buffer_compress_time_us("avg_log_buffer_compress_time_us");
-event_avg_counter
+event_hist_counter
   txn_logger::g_evt_avg_log_entry_ntxns("avg_log_entry_ntxns_per_entry");
-event_avg_counter
+event_hist_counter
   txn_logger::g_evt_avg_logger_bytes_per_writev("avg_logger_bytes_per_writev");
-event_avg_counter
+event_hist_counter
   txn_logger::g_evt_avg_logger_bytes_per_sec("avg_logger_bytes_per_sec");
 
-static event_avg_counter
+static event_hist_counter
   evt_avg_log_buffer_iov_len("avg_log_buffer_iov_len");
 
 void
@@ -217,6 +217,8 @@ txn_logger::advance_system_sync_epoch(
     }
   }
 
+  if (min_so_far > syssync)
+    commit_trace::epochs_durable(syssync + 1, min_so_far, rdtsc());
   system_sync_epoch_->store(min_so_far, memory_order_release);
 }
 
@@ -373,6 +375,7 @@ txn_logger::writer(
     //
     // return all buffers that have been io_scheduled_ - we can do this as
     // soon as write returns. we take care to return to the proper buffer
+    const uint64_t written_tsc = rdtsc();
     epoch_array &ea = per_thread_sync_epochs_[id];
     for (auto idx: assignment) {
       for (size_t k = idx; k < NMAXCORES; k += g_nworkers) {
@@ -396,6 +399,8 @@ txn_logger::writer(
           px0 = ctx.persist_buffers_.deq();
           INVARIANT(px == px0);
           INVARIANT(px->header()->nentries_);
+          commit_trace::buffer_written(
+              k, px0->header()->last_tid_, written_tsc);
           px0->reset();
           INVARIANT(ctx.init_);
           INVARIANT(px0->core_id_ == k);
@@ -709,9 +714,9 @@ event_counter
 event_counter
   transaction_proto2_static::g_evt_proto_gc_delete_requeue(
       "proto_gc_delete_requeue");
-event_avg_counter
+event_hist_counter
   transaction_proto2_static::g_evt_avg_log_entry_size(
       "avg_log_entry_size");
-event_avg_counter
+event_hist_counter
   transaction_proto2_static::g_evt_avg_proto_gc_queue_len(
       "avg_proto_gc_queue_len");
@@ -340,10 +340,10 @@ private:
   static event_counter g_evt_log_buffer_bytes_after_compress;
   static event_counter g_evt_logger_writev_limit_met;
   static event_counter g_evt_logger_max_lag_wait;
-  static event_avg_counter g_evt_avg_log_entry_ntxns;
-  static event_avg_counter g_evt_avg_log_buffer_compress_time_us;
-  static event_avg_counter g_evt_avg_logger_bytes_per_writev;
-  static event_avg_counter g_evt_avg_logger_bytes_per_sec;
+  static event_hist_counter g_evt_avg_log_entry_ntxns;
+  static event_hist_counter g_evt_avg_log_buffer_compress_time_us;
+  static event_hist_counter g_evt_avg_logger_bytes_per_writev;
+  static event_hist_counter g_evt_avg_logger_bytes_per_sec;
 };
 
 static inline std::ostream &
@@ -694,8 +694,8 @@ protected:
   static event_counter g_evt_worker_thread_wait_log_buffer;
   static event_counter g_evt_dbtuple_no_space_for_delkey;
   static event_counter g_evt_proto_gc_delete_requeue;
-  static event_avg_counter g_evt_avg_log_entry_size;
-  static event_avg_counter g_evt_avg_proto_gc_queue_len;
+  static event_hist_counter g_evt_avg_log_entry_size;
+  static event_hist_counter g_evt_avg_proto_gc_queue_len;
 };
 
 bool
@@ -885,6 +885,7 @@ public:
       if (written != space_needed)
         INVARIANT(false);
     }
+    commit_trace::log_enqueued(EpochId(commit_tid));
   }
 
 private:
@@ -960,6 +961,17 @@ public:
     return u_.last_consistent_tid;
   }
 
+  // reads t's snapshot instead of our own, so that several txns (ie the
+  // parts of a parallel scan) see the same state. t must outlive this txn-
+  // its RCU region is what keeps the snapshot from being gc-ed
+  inline void
+  adopt_snapshot(const transaction_proto2 &t)
+  {
+    INVARIANT(this->is_snapshot());
+    INVARIANT(t.is_snapshot());
+    u_.last_consistent_tid = t.u_.last_consistent_tid;
+  }
+
   void
   dump_debug_info() const
   {
@@ -1183,6 +1195,39 @@ struct base_txn_btree_handler<transaction_proto2> {
 #endif
   }
   static const bool has_background_task = true;
+  // sorts before every tid committed from this epoch on
+  static inline transaction_base::tid_t
+  load_tid()
+  {
+    return transaction_proto2_static::MakeTid(
+        0, 0, ticker::s_instance.global_current_tick());
+  }
+  // once every snapshot reads at or past the delete's read-only epoch
+  // (always, if there are no snapshots), nobody needs the versions the
+  // tombstone hides. this is the same point at which the GC queue entry made
+  // by on_logical_delete() becomes due- when that entry finally comes up,
+  // it finds the tuple no longer latest and just frees it
+  static inline bool
+  can_purge_tombstone(const dbtuple *tuple)
+  {
+#ifdef PROTO2_CAN_DISABLE_GC
+    // otherwise there is no queue entry to free the tuple
+    if (!transaction_proto2_static::IsGCEnabled())
+      return false;
+#endif
+#ifdef PROTO2_CAN_DISABLE_SNAPSHOTS
+    if (!transaction_proto2_static::IsSnapshotsEnabled())
+      return true;
+#endif
+    const uint64_t last_tick_ex = ticker::s_instance.global_last_tick_exclusive();
+    if (unlikely(!last_tick_ex))
+      return false;
+    // same horizon as on_post_rcu_region_completion()
+    const uint64_t ro_tick_ex =
+      transaction_proto2_static::to_read_only_tick(last_tick_ex - 1);
+    return transaction_proto2_static::to_read_only_tick(
+        transaction_proto2_static::EpochId(tuple->version)) < ro_tick_ex;
+  }
 };
 
 template <>
@@ -1214,6 +1259,13 @@ struct txn_epoch_sync<transaction_proto2> : public transaction_proto2_static {
   static void
   thread_end()
   {
+    if (::allocator::IsPersistent()) {
+      // nothing runs an exited thread's gc/rcu queues, and whatever is left
+      // in them would be leaked by (or, worse, still point into) the saved
+      // heap
+      transaction_proto2_static::PurgeThreadOutstandingGCTasks();
+      rcu::s_instance.drain();
+    }
     if (!txn_logger::IsPersistenceEnabled())
       return;
     const unsigned long my_core_id = coreid::core_id();
@@ -0,0 +1,56 @@
+#include <thread>
+#include <algorithm>
+
+#include "worker_pool.h"
+#include "core.h"
+
+using namespace std;
+
+worker_pool &worker_pool::s_instance = *new worker_pool;
+
+worker_pool::worker_pool()
+  : nthreads_(0), max_threads_(coreid::num_cpus_online())
+{
+}
+
+void
+worker_pool::set_max_threads(size_t n)
+{
+  ALWAYS_ASSERT(n > 0);
+  ALWAYS_ASSERT(n <= coreid::NMaxCores);
+  max_threads_ = n;
+}
+
+void
+worker_pool::run(const vector<function<void()>> &tasks)
+{
+  if (tasks.empty())
+    return;
+  batch b(tasks.size());
+  unique_lock<mutex> l(lock_);
+  while (nthreads_ < std::min(tasks.size(), max_threads_)) {
+    thread(&worker_pool::workerloop, this).detach();
+    nthreads_++;
+  }
+  for (auto &t : tasks)
+    queue_.emplace_back(&t, &b);
+  work_.notify_all();
+  b.done.wait(l, [&b]() { return !b.remaining; });
+}
+
+void
+worker_pool::workerloop()
+{
+  unique_lock<mutex> l(lock_);
+  for (;;) {
+    work_.wait(l, [this]() { return !queue_.empty(); });
+    const auto p = queue_.front();
+    queue_.pop_front();
+    l.unlock();
+    (*p.first)();
+    l.lock();
+    INVARIANT(p.second->remaining);
+    if (!--p.second->remaining)
+      p.second->done.notify_one();
+  }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+
+#include "macros.h"
+
+/**
+ * A set of daemon threads which run batches of tasks on behalf of a caller
+ * (ie the sub-ranges of a parallel scan).
+ *
+ * Threads are only ever added, never torn down- every thread which touches
+ * the db takes a core id for good (see coreid), so we cannot afford to spawn
+ * a fresh set per batch. For the same reason the pool is capped (by default
+ * at the number of cpus online): a batch w/ more tasks than that just runs
+ * them on the threads there are. The cap has to leave room in NMAXCORES for
+ * everything else which runs txns
+ */
+class worker_pool {
+public:
+
+  worker_pool();
+
+  worker_pool(const worker_pool &) = delete;
+  worker_pool(worker_pool &&) = delete;
+  worker_pool &operator=(const worker_pool &) = delete;
+
+  // runs every task, on up to min(tasks.size(), max_threads()) threads, and
+  // returns once all of them have. threadsafe, but must not be called from
+  // within a task
+  void run(const std::vector<std::function<void()>> &tasks);
+
+  inline size_t
+  max_threads() const
+  {
+    return max_threads_;
+  }
+
+  // threads already spawned are kept. not threadsafe, meant to be called at
+  // startup
+  void set_max_threads(size_t n);
+
+  // never destroyed, as the pool threads outlive main()
+  static worker_pool &s_instance;
+
+private:
+
+  struct batch {
+    batch(size_t n) : remaining(n) {}
+    size_t remaining;
+    std::condition_variable done;
+  };
+
+  void workerloop();
+
+  std::mutex lock_;
+  std::condition_variable work_;
+  std::deque<std::pair<const std::function<void()> *, batch *>> queue_;
+  size_t nthreads_;
+  size_t max_threads_;
+};